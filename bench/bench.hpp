@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+#include <mugfx.h>
+
+// The results are printed to stdout as JSON, so everything else goes to stderr.
+
+inline void bench_logger(mugfx_severity severity, const char* msg)
+{
+    std::fprintf(stderr, "[%s] %s\n", mugfx_severity_to_string(severity), msg);
+}
+
+inline void bench_panic_handler(const char* msg)
+{
+    bench_logger(MUGFX_SEVERITY_ERROR, msg);
+    std::abort();
+}
+
+// Accumulates wall time and CPU time of the calling thread over multiple start/stop pairs.
+// With llvmpipe the rasterization happens on other threads, so the CPU time only contains the work
+// of mugfx and the driver frontend.
+class Stopwatch {
+public:
+    void start()
+    {
+        wall_start_ = now(CLOCK_MONOTONIC);
+        cpu_start_ = now(CLOCK_THREAD_CPUTIME_ID);
+    }
+
+    void stop()
+    {
+        wall_ns_ += now(CLOCK_MONOTONIC) - wall_start_;
+        cpu_ns_ += now(CLOCK_THREAD_CPUTIME_ID) - cpu_start_;
+    }
+
+    double wall_ns() const { return wall_ns_; }
+    double cpu_ns() const { return cpu_ns_; }
+
+private:
+    static double now(clockid_t clock)
+    {
+        timespec ts;
+        clock_gettime(clock, &ts);
+        return static_cast<double>(ts.tv_sec) * 1e9 + static_cast<double>(ts.tv_nsec);
+    }
+
+    double wall_start_ = 0.0;
+    double cpu_start_ = 0.0;
+    double wall_ns_ = 0.0;
+    double cpu_ns_ = 0.0;
+};
+
+// {"suite": .., "renderer": .., "results": [{"name": .., <key>: <value>, ..}, ..]}
+class JsonReport {
+public:
+    JsonReport(const char* suite, const char* renderer)
+    {
+        std::printf("{\n  \"suite\": ");
+        print_string(suite);
+        std::printf(",\n  \"renderer\": ");
+        print_string(renderer);
+        std::printf(",\n  \"results\": [");
+    }
+
+    ~JsonReport()
+    {
+        if (num_results_ > 0) {
+            std::printf("}");
+        }
+        std::printf("\n  ]\n}\n");
+    }
+
+    void result(const char* name)
+    {
+        std::printf("%s\n    {\"name\": ", num_results_ > 0 ? "}," : "");
+        print_string(name);
+        num_results_++;
+    }
+
+    void value(const char* key, double value)
+    {
+        std::printf(", ");
+        print_string(key);
+        std::printf(": %.6g", value);
+    }
+
+    void value(const char* key, size_t value)
+    {
+        std::printf(", ");
+        print_string(key);
+        std::printf(": %zu", value);
+    }
+
+    void value(const char* key, const char* value)
+    {
+        std::printf(", ");
+        print_string(key);
+        std::printf(": ");
+        print_string(value);
+    }
+
+private:
+    static void print_string(const char* str)
+    {
+        std::putchar('"');
+        for (const char* c = str ? str : ""; *c; ++c) {
+            if (*c == '"' || *c == '\\') {
+                std::putchar('\\');
+            }
+            std::putchar(*c);
+        }
+        std::putchar('"');
+    }
+
+    size_t num_results_ = 0;
+};
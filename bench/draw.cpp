@@ -0,0 +1,303 @@
+#include <array>
+#include <cstdio>
+
+#include <mugfx.h>
+
+#include "bench.hpp"
+#include "headless.hpp"
+
+// Measures draw call throughput for different kinds of state changes between draws.
+// The quads are tiny, so the GPU (or llvmpipe) is never the bottleneck.
+
+constexpr size_t Width = 256;
+constexpr size_t Height = 256;
+constexpr size_t WarmupFrames = 10;
+constexpr size_t Frames = 100;
+constexpr size_t DrawsPerFrame = 1000;
+constexpr size_t NumMaterials = 8;
+constexpr size_t NumTextures = 64;
+constexpr size_t NumUniformData = 64;
+constexpr size_t NumParams = 16;
+
+const auto vert_source = R"(
+    #version 330 core
+
+    uniform vec4 u_offset;
+
+    layout (location = 0) in vec2 a_position;
+
+    out vec2 texcoord;
+
+    void main() {
+        texcoord = a_position * 0.5 + 0.5;
+        gl_Position = vec4(a_position * 0.01 + u_offset.xy, 0.0, 1.0);
+    }
+)";
+
+const auto instanced_vert_source = R"(
+    #version 330 core
+
+    uniform vec4 u_offset;
+
+    layout (location = 0) in vec2 a_position;
+
+    out vec2 texcoord;
+
+    void main() {
+        texcoord = a_position * 0.5 + 0.5;
+        vec2 offset = vec2(gl_InstanceID % 32, gl_InstanceID / 32) / 16.0 - 1.0;
+        gl_Position = vec4(a_position * 0.01 + u_offset.xy + offset, 0.0, 1.0);
+    }
+)";
+
+const auto params_vert_source = R"(
+    #version 330 core
+
+    uniform vec4 u_param0, u_param1, u_param2, u_param3, u_param4, u_param5, u_param6, u_param7;
+    uniform vec4 u_param8, u_param9, u_param10, u_param11, u_param12, u_param13, u_param14;
+    uniform vec4 u_param15;
+
+    layout (location = 0) in vec2 a_position;
+
+    out vec2 texcoord;
+
+    void main() {
+        vec4 sum = u_param0 + u_param1 + u_param2 + u_param3 + u_param4 + u_param5 + u_param6
+            + u_param7 + u_param8 + u_param9 + u_param10 + u_param11 + u_param12 + u_param13
+            + u_param14 + u_param15;
+        texcoord = a_position * 0.5 + 0.5;
+        gl_Position = vec4(a_position * 0.01 + sum.xy, 0.0, 1.0);
+    }
+)";
+
+const auto frag_source = R"(
+    #version 330 core
+
+    uniform sampler2D u_base;
+
+    in vec2 texcoord;
+
+    out vec4 frag_color;
+
+    void main() {
+        frag_color = texture(u_base, texcoord);
+    }
+)";
+
+const std::array<const char*, NumParams> param_names = { "u_param0", "u_param1", "u_param2",
+    "u_param3", "u_param4", "u_param5", "u_param6", "u_param7", "u_param8", "u_param9", "u_param10",
+    "u_param11", "u_param12", "u_param13", "u_param14", "u_param15" };
+
+mugfx_draw_binding uniform_binding(mugfx_uniform_data_id uniform_data)
+{
+    return { .type = MUGFX_BINDING_TYPE_UNIFORM_DATA, .uniform_data = { .id = uniform_data } };
+}
+
+mugfx_draw_binding texture_binding(mugfx_texture_id texture)
+{
+    return { .type = MUGFX_BINDING_TYPE_TEXTURE, .texture = { .binding = 0, .id = texture } };
+}
+
+void add_stats(mugfx_frame_stats& total, const mugfx_frame_stats& frame)
+{
+    total.draws += frame.draws;
+    total.instances += frame.instances;
+    total.program_binds += frame.program_binds;
+    total.vao_binds += frame.vao_binds;
+    total.texture_binds += frame.texture_binds;
+    total.buffer_binds += frame.buffer_binds;
+    total.bind_cache_hits += frame.bind_cache_hits;
+    total.uniform_calls += frame.uniform_calls;
+    total.uniform_bytes += frame.uniform_bytes;
+}
+
+// `draw_frame` records all draws of a single frame
+template <typename Func>
+void run(JsonReport& report, const HeadlessContext& ctx, const char* name, size_t draws_per_frame,
+    size_t instances_per_draw, Func&& draw_frame)
+{
+    for (size_t f = 0; f < WarmupFrames; ++f) {
+        mugfx_begin_frame();
+        draw_frame();
+        mugfx_end_frame();
+    }
+    ctx.finish();
+
+    Stopwatch submit, frame;
+    mugfx_frame_stats stats = {};
+    for (size_t f = 0; f < Frames; ++f) {
+        frame.start();
+        submit.start();
+        mugfx_begin_frame();
+        draw_frame();
+        submit.stop();
+        mugfx_end_frame();
+        ctx.finish();
+        frame.stop();
+        add_stats(stats, mugfx_get_frame_stats());
+    }
+
+    const auto draws = static_cast<double>(draws_per_frame * Frames);
+    const auto binds
+        = stats.program_binds + stats.vao_binds + stats.texture_binds + stats.buffer_binds;
+    report.result(name);
+    report.value("frames", Frames);
+    report.value("draws_per_frame", draws_per_frame);
+    report.value("instances_per_frame", draws_per_frame * instances_per_draw);
+    report.value("submit_cpu_ns_per_draw", submit.cpu_ns() / draws);
+    report.value("submit_wall_ns_per_draw", submit.wall_ns() / draws);
+    report.value("draws_per_sec", draws / (submit.wall_ns() * 1e-9));
+    report.value("instances_per_sec", draws * instances_per_draw / (frame.wall_ns() * 1e-9));
+    report.value("frame_ms", frame.wall_ns() / Frames * 1e-6);
+    // These are zero if mugfx was built without MUGFX_ENABLE_FRAME_STATS
+    report.value("binds_per_draw", binds / draws);
+    report.value("program_binds_per_draw", stats.program_binds / draws);
+    report.value("vao_binds_per_draw", stats.vao_binds / draws);
+    report.value("texture_binds_per_draw", stats.texture_binds / draws);
+    report.value("bind_cache_hits_per_draw", stats.bind_cache_hits / draws);
+    report.value("uniform_calls_per_draw", stats.uniform_calls / draws);
+    report.value("uniform_bytes_per_draw", stats.uniform_bytes / draws);
+}
+
+int main()
+{
+    const auto ctx = HeadlessContext::create(Width, Height);
+
+    mugfx_init({
+        .logging_callback = bench_logger,
+        .panic_handler = bench_panic_handler,
+        .get_proc_address = HeadlessContext::get_proc_address,
+    });
+
+    const mugfx_uniform_descriptor offset_uniforms {
+        .uniforms = { { .name = "u_offset", .type = MUGFX_UNIFORM_TYPE_VEC4 } },
+    };
+    mugfx_uniform_descriptor param_uniforms = {};
+    for (size_t i = 0; i < NumParams; ++i) {
+        param_uniforms.uniforms[i] = { .name = param_names[i], .type = MUGFX_UNIFORM_TYPE_VEC4 };
+    }
+
+    const auto vert_shader = mugfx_shader_create({
+        .stage = MUGFX_SHADER_STAGE_VERTEX,
+        .source = vert_source,
+        .uniform_descriptors = { &offset_uniforms },
+    });
+    const auto instanced_vert_shader = mugfx_shader_create({
+        .stage = MUGFX_SHADER_STAGE_VERTEX,
+        .source = instanced_vert_source,
+        .uniform_descriptors = { &offset_uniforms },
+    });
+    const auto params_vert_shader = mugfx_shader_create({
+        .stage = MUGFX_SHADER_STAGE_VERTEX,
+        .source = params_vert_source,
+        .uniform_descriptors = { &param_uniforms },
+    });
+    const auto frag_shader = mugfx_shader_create({
+        .stage = MUGFX_SHADER_STAGE_FRAGMENT,
+        .source = frag_source,
+        .samplers = { { .name = "u_base", .binding = 0 } },
+    });
+
+    // Every material links its own program, so alternating between them changes the program
+    std::array<mugfx_material_id, NumMaterials> materials;
+    for (auto& material : materials) {
+        material = mugfx_material_create({ .vert_shader = vert_shader, .frag_shader = frag_shader });
+    }
+    const auto instanced_material = mugfx_material_create(
+        { .vert_shader = instanced_vert_shader, .frag_shader = frag_shader });
+    const auto params_material
+        = mugfx_material_create({ .vert_shader = params_vert_shader, .frag_shader = frag_shader });
+
+    std::array<mugfx_texture_id, NumTextures> textures;
+    for (size_t i = 0; i < textures.size(); ++i) {
+        std::array<uint32_t, 16> pixels;
+        pixels.fill(0xFF000000u | static_cast<uint32_t>(i * 0x030507));
+        textures[i] = mugfx_texture_create({
+            .width = 4,
+            .height = 4,
+            .data = { pixels.data(), pixels.size() * sizeof(pixels[0]) },
+        });
+    }
+
+    const std::array<float, 12> vertices
+        = { -1.0f, -1.0f, 1.0f, -1.0f, 1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, -1.0f, 1.0f };
+    const auto vertex_buffer = mugfx_buffer_create({
+        .target = MUGFX_BUFFER_TARGET_ARRAY,
+        .data = { vertices.data(), vertices.size() * sizeof(float) },
+    });
+    const auto geometry = mugfx_geometry_create({
+        .vertex_buffers = {
+            {
+                .buffer = vertex_buffer,
+                .attributes = {
+                    { .location = 0, .components = 2, .type = MUGFX_VERTEX_ATTRIBUTE_TYPE_F32 },
+                },
+            },
+        },
+        .vertex_count = 6,
+    });
+
+    const auto offset_data = mugfx_uniform_data_create({ .descriptor = &offset_uniforms });
+    const std::array<float, 4> offset = { -0.5f, 0.5f, 0.0f, 0.0f };
+    mugfx_uniform_data_set_float(offset_data, "u_offset", { offset.data(), sizeof(offset) });
+
+    std::array<mugfx_uniform_data_id, NumUniformData> param_data;
+    for (auto& data : param_data) {
+        data = mugfx_uniform_data_create({ .descriptor = &param_uniforms });
+    }
+
+    mugfx_set_viewport(0, 0, Width, Height);
+
+    JsonReport report("draw", ctx.renderer());
+
+    std::array<mugfx_draw_binding, 2> bindings
+        = { uniform_binding(offset_data), texture_binding(textures[0]) };
+
+    run(report, ctx, "same_material", DrawsPerFrame, 1, [&] {
+        for (size_t i = 0; i < DrawsPerFrame; ++i) {
+            mugfx_draw(materials[0], geometry, bindings.data(), bindings.size());
+        }
+    });
+
+    run(report, ctx, "alternating_materials", DrawsPerFrame, 1, [&] {
+        for (size_t i = 0; i < DrawsPerFrame; ++i) {
+            mugfx_draw(materials[i % NumMaterials], geometry, bindings.data(), bindings.size());
+        }
+    });
+
+    run(report, ctx, "many_textures", DrawsPerFrame, 1, [&] {
+        for (size_t i = 0; i < DrawsPerFrame; ++i) {
+            std::array<mugfx_draw_binding, 2> b
+                = { uniform_binding(offset_data), texture_binding(textures[i % NumTextures]) };
+            mugfx_draw(materials[0], geometry, b.data(), b.size());
+        }
+    });
+
+    // Every uniform data is changed once per frame, like per-object transforms would be
+    std::array<float, 4> param = { 0.0f, 0.0f, 0.0f, 0.0f };
+    run(report, ctx, "many_uniforms", DrawsPerFrame, 1, [&] {
+        param[0] += 0.001f;
+        for (const auto data : param_data) {
+            mugfx_uniform_data_set_float(data, param_names[0], { param.data(), sizeof(param) });
+        }
+        for (size_t i = 0; i < DrawsPerFrame; ++i) {
+            std::array<mugfx_draw_binding, 2> b = { uniform_binding(param_data[i % NumUniformData]),
+                texture_binding(textures[0]) };
+            mugfx_draw(params_material, geometry, b.data(), b.size());
+        }
+    });
+
+    // The same objects, once drawn one by one and once with a single instanced draw
+    run(report, ctx, "non_instanced", DrawsPerFrame, 1, [&] {
+        for (size_t i = 0; i < DrawsPerFrame; ++i) {
+            mugfx_draw(instanced_material, geometry, bindings.data(), bindings.size());
+        }
+    });
+
+    run(report, ctx, "instanced", 1, DrawsPerFrame, [&] {
+        mugfx_draw_instanced(
+            instanced_material, geometry, bindings.data(), bindings.size(), DrawsPerFrame);
+    });
+
+    return 0;
+}
@@ -0,0 +1,143 @@
+#include "headless.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+namespace {
+// Not linking libGL, so these are loaded through EGL
+constexpr unsigned int GL_RENDERER = 0x1F01;
+using GlFinish = void (*)();
+using GlGetString = const unsigned char* (*)(unsigned int name);
+
+EGLDisplay get_display()
+{
+    // Surfaceless does not need a running X11 or Wayland server
+    const auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+        eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (get_platform_display) {
+        const auto display
+            = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if (display != EGL_NO_DISPLAY) {
+            return display;
+        }
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+}
+
+struct HeadlessContext::Impl {
+    bool init(size_t width, size_t height)
+    {
+        display = get_display();
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+            std::fprintf(stderr, "Could not initialize EGL\n");
+            return false;
+        }
+
+        if (!eglBindAPI(EGL_OPENGL_API)) {
+            std::fprintf(stderr, "Could not bind OpenGL API\n");
+            return false;
+        }
+
+        const EGLint config_attribs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, //
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, //
+            EGL_RED_SIZE, 8, //
+            EGL_GREEN_SIZE, 8, //
+            EGL_BLUE_SIZE, 8, //
+            EGL_ALPHA_SIZE, 8, //
+            EGL_DEPTH_SIZE, 24, //
+            EGL_NONE, //
+        };
+        EGLConfig config;
+        EGLint num_configs = 0;
+        if (!eglChooseConfig(display, config_attribs, &config, 1, &num_configs)
+            || num_configs == 0) {
+            std::fprintf(stderr, "Could not find EGL config\n");
+            return false;
+        }
+
+        const EGLint context_attribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3, //
+            EGL_CONTEXT_MINOR_VERSION, 3, //
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, //
+            EGL_NONE, //
+        };
+        ctx = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+        if (ctx == EGL_NO_CONTEXT) {
+            std::fprintf(stderr, "Could not create context\n");
+            return false;
+        }
+
+        const EGLint surface_attribs[] = {
+            EGL_WIDTH, static_cast<EGLint>(width), //
+            EGL_HEIGHT, static_cast<EGLint>(height), //
+            EGL_NONE, //
+        };
+        surface = eglCreatePbufferSurface(display, config, surface_attribs);
+        if (surface == EGL_NO_SURFACE) {
+            std::fprintf(stderr, "Could not create pbuffer surface\n");
+            return false;
+        }
+
+        if (!eglMakeCurrent(display, surface, surface, ctx)) {
+            std::fprintf(stderr, "Could not make context current\n");
+            return false;
+        }
+
+        gl_finish = reinterpret_cast<GlFinish>(get_proc_address("glFinish"));
+        gl_get_string = reinterpret_cast<GlGetString>(get_proc_address("glGetString"));
+        return gl_finish && gl_get_string;
+    }
+
+    ~Impl()
+    {
+        if (display != EGL_NO_DISPLAY) {
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (surface != EGL_NO_SURFACE) {
+                eglDestroySurface(display, surface);
+            }
+            if (ctx != EGL_NO_CONTEXT) {
+                eglDestroyContext(display, ctx);
+            }
+            eglTerminate(display);
+        }
+    }
+
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext ctx = EGL_NO_CONTEXT;
+    EGLSurface surface = EGL_NO_SURFACE;
+    GlFinish gl_finish = nullptr;
+    GlGetString gl_get_string = nullptr;
+};
+
+HeadlessContext HeadlessContext::create(size_t width, size_t height)
+{
+    auto impl = std::make_unique<Impl>();
+    if (!impl->init(width, height)) { // already logged an error
+        std::abort();
+    }
+    return HeadlessContext(std::move(impl));
+}
+
+HeadlessContext::~HeadlessContext() = default;
+
+void HeadlessContext::finish() const
+{
+    impl_->gl_finish();
+}
+
+const char* HeadlessContext::renderer() const
+{
+    return reinterpret_cast<const char*>(impl_->gl_get_string(GL_RENDERER));
+}
+
+void* HeadlessContext::get_proc_address(const char* name)
+{
+    return reinterpret_cast<void*>(eglGetProcAddress(name));
+}
+
+HeadlessContext::HeadlessContext(std::unique_ptr<Impl> impl) : impl_(std::move(impl)) { }
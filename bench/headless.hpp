@@ -0,0 +1,24 @@
+#include <memory>
+
+// An offscreen OpenGL context, which needs neither a window nor a display. It uses EGL, so the
+// benchmarks run on Mesa's llvmpipe in CI (set LIBGL_ALWAYS_SOFTWARE=1 to force it on machines
+// with a GPU).
+struct HeadlessContext {
+public:
+    static HeadlessContext create(size_t width, size_t height);
+    HeadlessContext(HeadlessContext&& other) = default;
+    ~HeadlessContext();
+
+    // Waits until the GPU finished all previous commands (glFinish)
+    void finish() const;
+    const char* renderer() const; // GL_RENDERER
+
+    static void* get_proc_address(const char* name);
+
+private:
+    struct Impl;
+
+    HeadlessContext(std::unique_ptr<Impl> impl);
+
+    std::unique_ptr<Impl> impl_;
+};
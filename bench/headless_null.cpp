@@ -0,0 +1,26 @@
+#include "headless.hpp"
+
+// Used with the Null backend, which needs no context. This only measures the CPU overhead of mugfx.
+
+struct HeadlessContext::Impl { };
+
+HeadlessContext HeadlessContext::create(size_t width, size_t height)
+{
+    return HeadlessContext(std::make_unique<Impl>());
+}
+
+HeadlessContext::~HeadlessContext() = default;
+
+void HeadlessContext::finish() const { }
+
+const char* HeadlessContext::renderer() const
+{
+    return "null";
+}
+
+void* HeadlessContext::get_proc_address(const char* name)
+{
+    return nullptr;
+}
+
+HeadlessContext::HeadlessContext(std::unique_ptr<Impl> impl) : impl_(std::move(impl)) { }
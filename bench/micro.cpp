@@ -0,0 +1,184 @@
+#include <array>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "shared.hpp"
+
+// Internal data structures that are used on every API call. None of these need a context.
+
+namespace {
+void init_allocator()
+{
+    static bool initialized = false;
+    if (!initialized) {
+        mugfx_init_params params = {};
+        common_init(params);
+        initialized = true;
+    }
+}
+
+// Roughly the size of the smaller resources (buffers, textures)
+struct Payload {
+    std::array<uint64_t, 8> data;
+};
+
+void BM_PoolInsertRemove(benchmark::State& state)
+{
+    init_allocator();
+    Pool<Payload> pool(1024);
+    for (auto _ : state) {
+        const auto key = pool.insert(Payload {});
+        benchmark::DoNotOptimize(key);
+        pool.remove(key);
+    }
+}
+BENCHMARK(BM_PoolInsertRemove);
+
+// Removes and inserts random elements of a pool that is filled to `range(0)` elements
+void BM_PoolChurn(benchmark::State& state)
+{
+    init_allocator();
+    const auto count = static_cast<size_t>(state.range(0));
+    Pool<Payload> pool(count);
+    std::vector<uint32_t> keys(count);
+    for (auto& key : keys) {
+        key = pool.insert(Payload {});
+    }
+    std::minstd_rand rng(42);
+    for (auto _ : state) {
+        auto& key = keys[rng() % count];
+        pool.remove(key);
+        key = pool.insert(Payload {});
+        benchmark::DoNotOptimize(key);
+    }
+}
+BENCHMARK(BM_PoolChurn)->Arg(64)->Arg(1024)->Arg(16384);
+
+void BM_PoolGet(benchmark::State& state)
+{
+    init_allocator();
+    const auto count = static_cast<size_t>(state.range(0));
+    Pool<Payload> pool(count);
+    std::vector<uint32_t> keys(count);
+    for (auto& key : keys) {
+        key = pool.insert(Payload {});
+    }
+    std::minstd_rand rng(42);
+    std::vector<uint32_t> lookups(4096);
+    for (auto& key : lookups) {
+        key = keys[rng() % count];
+    }
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(pool.get(lookups[i++ % lookups.size()]));
+    }
+}
+BENCHMARK(BM_PoolGet)->Arg(64)->Arg(1024)->Arg(16384);
+
+void BM_PoolGetInvalid(benchmark::State& state)
+{
+    init_allocator();
+    Pool<Payload> pool(1024);
+    const auto key = pool.insert(Payload {});
+    pool.remove(key);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(pool.get(key));
+    }
+}
+BENCHMARK(BM_PoolGetInvalid);
+
+void BM_StackStringCreate(benchmark::State& state)
+{
+    const auto str = std::string(static_cast<size_t>(state.range(0)), 'a');
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(StackString<>::create(str.c_str()));
+    }
+}
+BENCHMARK(BM_StackStringCreate)->Arg(8)->Arg(32)->Arg(127);
+
+// Compares against an equal string, a string with a different length and one that only differs in
+// the last character
+void BM_StackStringCompare(benchmark::State& state)
+{
+    const auto len = static_cast<size_t>(state.range(0));
+    const auto a = *StackString<>::create(std::string(len, 'a').c_str());
+    const std::array<StackString<>, 3> others = {
+        *StackString<>::create(std::string(len, 'a').c_str()),
+        *StackString<>::create(std::string(len + 1, 'a').c_str()),
+        *StackString<>::create((std::string(len - 1, 'a') + "b").c_str()),
+    };
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(a == others[i++ % others.size()]);
+    }
+}
+BENCHMARK(BM_StackStringCompare)->Arg(8)->Arg(32)->Arg(100);
+
+// Interns a string that is already in a table with `range(0)` other strings
+void BM_InternExisting(benchmark::State& state)
+{
+    init_allocator();
+    for (size_t i = 0; i < static_cast<size_t>(state.range(0)); ++i) {
+        intern("u_existing_" + std::to_string(i));
+    }
+    const auto name = std::string("u_existing_0");
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(intern(name));
+    }
+}
+BENCHMARK(BM_InternExisting)->Arg(16)->Arg(1024);
+
+std::array<UniformMetadata, MUGFX_MAX_UNIFORMS> make_uniform_metadata(size_t count)
+{
+    init_allocator();
+    std::array<UniformMetadata, MUGFX_MAX_UNIFORMS> metadata = {};
+    for (size_t i = 0; i < count; ++i) {
+        const auto name = "u_uniform_" + std::to_string(i);
+        metadata[i].name = intern(name);
+        metadata[i].name_hash = hash_string(name);
+        metadata[i].type = MUGFX_UNIFORM_TYPE_VEC4;
+    }
+    return metadata;
+}
+
+// Looks up the first, the middle and the last of all uniforms
+void BM_GetUniformIndex(benchmark::State& state)
+{
+    const auto metadata = make_uniform_metadata(MUGFX_MAX_UNIFORMS);
+    const auto name = "u_uniform_" + std::to_string(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(get_uniform_index(metadata, name.c_str()));
+    }
+}
+BENCHMARK(BM_GetUniformIndex)->Arg(0)->Arg(MUGFX_MAX_UNIFORMS / 2)->Arg(MUGFX_MAX_UNIFORMS - 1);
+
+void BM_GetUniformIndexMissing(benchmark::State& state)
+{
+    const auto metadata = make_uniform_metadata(MUGFX_MAX_UNIFORMS);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(get_uniform_index(metadata, "u_missing"));
+    }
+}
+BENCHMARK(BM_GetUniformIndexMissing);
+
+void BM_UniformDescriptorCalculateLayout(benchmark::State& state)
+{
+    constexpr std::array<mugfx_uniform_type, 5> types = { MUGFX_UNIFORM_TYPE_FLOAT,
+        MUGFX_UNIFORM_TYPE_VEC3, MUGFX_UNIFORM_TYPE_MAT4, MUGFX_UNIFORM_TYPE_VEC2,
+        MUGFX_UNIFORM_TYPE_MAT3 };
+    mugfx_uniform_descriptor descriptor = {};
+    for (size_t i = 0; i < static_cast<size_t>(state.range(0)); ++i) {
+        descriptor.uniforms[i] = { .name = "u", .type = types[i % types.size()] };
+    }
+    for (auto _ : state) {
+        mugfx_uniform_descriptor_calculate_layout(&descriptor);
+        benchmark::DoNotOptimize(descriptor.size);
+    }
+}
+BENCHMARK(BM_UniformDescriptorCalculateLayout)->Arg(1)->Arg(8)->Arg(MUGFX_MAX_UNIFORMS);
+}
+
+BENCHMARK_MAIN();
@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <mugfx.h>
+
+#include "bench.hpp"
+#include "headless.hpp"
+
+// Replays a capture (see mugfx_capture_params) in a headless context and reports frame times, so
+// a captured workload can be compared across mugfx versions, drivers and settings.
+// Usage: mugfx_replay <capture> [width] [height]
+
+// Chunks are read into uint64_t storage, because mugfx_replay_chunk needs them 8-byte aligned
+bool read_chunk(std::FILE* file, std::vector<uint64_t>& chunk, size_t& size)
+{
+    mugfx_capture_chunk_header header;
+    if (std::fread(&header, sizeof(header), 1, file) != 1) {
+        return false;
+    }
+    size = sizeof(header) + header.size;
+    chunk.resize((size + 7) / 8);
+    std::memcpy(chunk.data(), &header, sizeof(header));
+    const auto data = reinterpret_cast<char*>(chunk.data()) + sizeof(header);
+    return std::fread(data, 1, header.size, file) == header.size;
+}
+
+double percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    const auto idx = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::fprintf(stderr, "Usage: %s <capture> [width] [height]\n", argv[0]);
+        return 1;
+    }
+    const auto width = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1024;
+    const auto height = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 768;
+
+    const auto file = std::fopen(argv[1], "rb");
+    if (!file) {
+        std::fprintf(stderr, "Could not open '%s'\n", argv[1]);
+        return 1;
+    }
+
+    const auto ctx = HeadlessContext::create(width, height);
+
+    const mugfx_init_params init_params {
+        .logging_callback = bench_logger,
+        .panic_handler = bench_panic_handler,
+        .get_proc_address = HeadlessContext::get_proc_address,
+    };
+
+    // A frame may span multiple chunks. The time of a frame is everything from the first chunk
+    // after the previous frame to the glFinish after the chunk that ends it.
+    std::vector<double> frame_ms;
+    std::vector<uint64_t> chunk;
+    size_t size = 0;
+    size_t num_chunks = 0;
+    uint64_t frame = 0;
+    mugfx_frame_stats totals = {};
+    Stopwatch total;
+    Stopwatch sw;
+    total.start();
+    sw.start();
+    while (read_chunk(file, chunk, size)) {
+        const auto header = reinterpret_cast<const mugfx_capture_chunk_header*>(chunk.data());
+        if (header->frame != frame) {
+            ctx.finish();
+            sw.stop();
+            frame_ms.push_back(sw.wall_ns() * 1e-6);
+            sw = Stopwatch {};
+            sw.start();
+
+            const auto stats = mugfx_get_frame_stats();
+            totals.draws += stats.draws;
+            totals.instances += stats.instances;
+            totals.triangles += stats.triangles;
+            totals.program_binds += stats.program_binds;
+            totals.texture_binds += stats.texture_binds;
+            frame = header->frame;
+        }
+        if (!mugfx_replay_chunk(chunk.data(), size, &init_params)) {
+            std::fprintf(stderr, "Invalid chunk %zu\n", num_chunks);
+            return 1;
+        }
+        num_chunks++;
+    }
+    // The last frame may be incomplete, so it is not counted
+    ctx.finish();
+    total.stop();
+    std::fclose(file);
+
+    auto sorted = frame_ms;
+    std::sort(sorted.begin(), sorted.end());
+    double sum = 0.0;
+    for (const auto ms : frame_ms) {
+        sum += ms;
+    }
+
+    JsonReport report("replay", ctx.renderer());
+    report.result(argv[1]);
+    report.value("chunks", num_chunks);
+    report.value("frames", frame_ms.size());
+    report.value("total_ms", total.wall_ns() * 1e-6);
+    report.value("mean_ms", frame_ms.empty() ? 0.0 : sum / static_cast<double>(frame_ms.size()));
+    report.value("median_ms", percentile(sorted, 0.5));
+    report.value("p99_ms", percentile(sorted, 0.99));
+    report.value("max_ms", sorted.empty() ? 0.0 : sorted.back());
+    report.value("draws", static_cast<size_t>(totals.draws));
+    report.value("instances", static_cast<size_t>(totals.instances));
+    report.value("triangles", static_cast<size_t>(totals.triangles));
+    report.value("program_binds", static_cast<size_t>(totals.program_binds));
+    report.value("texture_binds", static_cast<size_t>(totals.texture_binds));
+
+    return 0;
+}
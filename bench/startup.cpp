@@ -0,0 +1,246 @@
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <mugfx.h>
+
+#include "bench.hpp"
+#include "headless.hpp"
+
+// Measures mugfx_init and bulk creation and destruction of resources at counts a small game would
+// use at startup. Every shader gets a unique source, so the driver's shader cache does not hide
+// the compile time (for llvmpipe also set MESA_SHADER_CACHE_DISABLE=1 to disable the disk cache).
+
+constexpr size_t NumShaderPairs = 32;
+constexpr size_t NumMaterials = 256;
+constexpr size_t NumTextures = 128;
+constexpr size_t TextureSize = 256;
+constexpr size_t NumBuffers = 512;
+constexpr size_t NumGeometries = 512;
+constexpr size_t NumUniformData = 512;
+
+const auto vert_source = R"(
+    #version 330 core
+
+    uniform mat4 u_transform;
+
+    layout (location = 0) in vec3 a_position;
+    layout (location = 1) in vec2 a_texcoord;
+
+    out vec2 texcoord;
+
+    void main() {
+        texcoord = a_texcoord;
+        gl_Position = u_transform * vec4(a_position, 1.0);
+    }
+)";
+
+const auto frag_source = R"(
+    #version 330 core
+
+    uniform sampler2D u_base;
+
+    in vec2 texcoord;
+
+    out vec4 frag_color;
+
+    void main() {
+        frag_color = texture(u_base, texcoord);
+    }
+)";
+
+// Tracks the memory mugfx allocates through its allocator
+struct CountingAllocator {
+    size_t current = 0;
+    size_t peak = 0;
+    size_t num_allocations = 0;
+
+    void add(size_t size)
+    {
+        current += size;
+        peak = current > peak ? current : peak;
+    }
+
+    static void* allocate(size_t size, void* ctx)
+    {
+        auto& self = *static_cast<CountingAllocator*>(ctx);
+        self.add(size);
+        self.num_allocations++;
+        return std::malloc(size);
+    }
+
+    static void* reallocate(void* ptr, size_t old_size, size_t new_size, void* ctx)
+    {
+        auto& self = *static_cast<CountingAllocator*>(ctx);
+        self.current -= old_size;
+        self.add(new_size);
+        return std::realloc(ptr, new_size);
+    }
+
+    static void deallocate(void* ptr, size_t size, void* ctx)
+    {
+        static_cast<CountingAllocator*>(ctx)->current -= size;
+        std::free(ptr);
+    }
+};
+
+size_t max_rss_bytes()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+}
+
+// Calls `func(i)` `count` times and reports the time per call
+template <typename Func>
+void measure(JsonReport& report, const CountingAllocator& allocator, const HeadlessContext& ctx,
+    const char* name, size_t count, Func&& func)
+{
+    Stopwatch sw;
+    sw.start();
+    for (size_t i = 0; i < count; ++i) {
+        func(i);
+    }
+    // Drivers may defer work (e.g. shader compilation or uploads) until the objects are used
+    ctx.finish();
+    sw.stop();
+
+    report.result(name);
+    report.value("count", count);
+    report.value("wall_us_per_call", sw.wall_ns() / count * 1e-3);
+    report.value("cpu_us_per_call", sw.cpu_ns() / count * 1e-3);
+    report.value("total_ms", sw.wall_ns() * 1e-6);
+    report.value("mugfx_bytes", allocator.current);
+    report.value("mugfx_bytes_peak", allocator.peak);
+    report.value("max_rss_bytes", max_rss_bytes());
+}
+
+int main()
+{
+    const auto ctx = HeadlessContext::create(64, 64);
+
+    JsonReport report("startup", ctx.renderer());
+
+    CountingAllocator counting;
+    mugfx_allocator allocator {
+        .allocate = CountingAllocator::allocate,
+        .reallocate = CountingAllocator::reallocate,
+        .deallocate = CountingAllocator::deallocate,
+        .ctx = &counting,
+    };
+
+    // Includes loading the GL functions and allocating all pools
+    measure(report, counting, ctx, "init", 1, [&](size_t) {
+        mugfx_init({
+            .logging_callback = bench_logger,
+            .panic_handler = bench_panic_handler,
+            .allocator = &allocator,
+            .get_proc_address = HeadlessContext::get_proc_address,
+        });
+    });
+
+    const mugfx_uniform_descriptor uniforms {
+        .uniforms = { { .name = "u_transform", .type = MUGFX_UNIFORM_TYPE_MAT4 } },
+    };
+
+    std::vector<std::string> vert_sources, frag_sources;
+    for (size_t i = 0; i < NumShaderPairs; ++i) {
+        vert_sources.push_back(std::string(vert_source) + "// " + std::to_string(i) + "\n");
+        frag_sources.push_back(std::string(frag_source) + "// " + std::to_string(i) + "\n");
+    }
+
+    std::vector<mugfx_shader_id> vert_shaders(NumShaderPairs), frag_shaders(NumShaderPairs);
+    measure(report, counting, ctx, "shader_create", NumShaderPairs * 2, [&](size_t i) {
+        if (i % 2 == 0) {
+            vert_shaders[i / 2] = mugfx_shader_create({
+                .stage = MUGFX_SHADER_STAGE_VERTEX,
+                .source = vert_sources[i / 2].c_str(),
+                .uniform_descriptors = { &uniforms },
+            });
+        } else {
+            frag_shaders[i / 2] = mugfx_shader_create({
+                .stage = MUGFX_SHADER_STAGE_FRAGMENT,
+                .source = frag_sources[i / 2].c_str(),
+                .samplers = { { .name = "u_base", .binding = 0 } },
+            });
+        }
+    });
+
+    std::vector<mugfx_material_id> materials(NumMaterials);
+    measure(report, counting, ctx, "material_create", NumMaterials, [&](size_t i) {
+        materials[i] = mugfx_material_create({
+            .vert_shader = vert_shaders[i % NumShaderPairs],
+            .frag_shader = frag_shaders[i % NumShaderPairs],
+        });
+    });
+
+    std::vector<uint32_t> pixels(TextureSize * TextureSize, 0xFF808080u);
+    std::vector<mugfx_texture_id> textures(NumTextures);
+    measure(report, counting, ctx, "texture_create", NumTextures, [&](size_t i) {
+        textures[i] = mugfx_texture_create({
+            .width = TextureSize,
+            .height = TextureSize,
+            .generate_mipmaps = true,
+            .data = { pixels.data(), pixels.size() * sizeof(uint32_t) },
+        });
+    });
+
+    // A cube with position and texcoord
+    std::array<float, 36 * 5> vertices = {};
+    std::vector<mugfx_buffer_id> buffers(NumBuffers);
+    measure(report, counting, ctx, "buffer_create", NumBuffers, [&](size_t i) {
+        buffers[i] = mugfx_buffer_create({
+            .target = MUGFX_BUFFER_TARGET_ARRAY,
+            .data = { vertices.data(), vertices.size() * sizeof(float) },
+        });
+    });
+
+    std::vector<mugfx_geometry_id> geometries(NumGeometries);
+    measure(report, counting, ctx, "geometry_create", NumGeometries, [&](size_t i) {
+        geometries[i] = mugfx_geometry_create({
+            .vertex_buffers = {
+                {
+                    .buffer = buffers[i % NumBuffers],
+                    .attributes = {
+                        { .location = 0, .components = 3, .type = MUGFX_VERTEX_ATTRIBUTE_TYPE_F32 },
+                        { .location = 1, .components = 2, .type = MUGFX_VERTEX_ATTRIBUTE_TYPE_F32 },
+                    },
+                },
+            },
+            .vertex_count = 36,
+        });
+    });
+
+    std::vector<mugfx_uniform_data_id> uniform_data(NumUniformData);
+    measure(report, counting, ctx, "uniform_data_create", NumUniformData,
+        [&](size_t i) { uniform_data[i] = mugfx_uniform_data_create({ .descriptor = &uniforms }); });
+
+    // Destroy in reverse dependency order, like an application would on shutdown
+    measure(report, counting, ctx, "uniform_data_destroy", NumUniformData,
+        [&](size_t i) { mugfx_uniform_data_destroy(uniform_data[i]); });
+    measure(report, counting, ctx, "geometry_destroy", NumGeometries,
+        [&](size_t i) { mugfx_geometry_destroy(geometries[i]); });
+    measure(report, counting, ctx, "buffer_destroy", NumBuffers,
+        [&](size_t i) { mugfx_buffer_destroy(buffers[i]); });
+    measure(report, counting, ctx, "texture_destroy", NumTextures,
+        [&](size_t i) { mugfx_texture_destroy(textures[i]); });
+    measure(report, counting, ctx, "material_destroy", NumMaterials,
+        [&](size_t i) { mugfx_material_destroy(materials[i]); });
+    measure(report, counting, ctx, "shader_destroy", NumShaderPairs * 2, [&](size_t i) {
+        mugfx_shader_destroy(i % 2 == 0 ? vert_shaders[i / 2] : frag_shaders[i / 2]);
+    });
+
+    // Frees everything mugfx still holds (pools, interned names, etc.) while `allocator` is alive,
+    // so afterwards nothing may be left
+    measure(report, counting, ctx, "shutdown", 1, [&](size_t) { mugfx_shutdown(); });
+    if (counting.current != 0) {
+        std::fprintf(stderr, "%zu bytes were not freed by mugfx_shutdown\n", counting.current);
+        return 1;
+    }
+
+    return 0;
+}
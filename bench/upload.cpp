@@ -0,0 +1,220 @@
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <mugfx.h>
+
+#include "bench.hpp"
+#include "headless.hpp"
+
+// Measures upload bandwidth of buffers and textures for different sizes, formats, usage hints and
+// update patterns. Every measurement ends with glFinish, because drivers may defer the copy.
+
+constexpr size_t MaxUploadSize = 64 * 1024 * 1024;
+// Every case uploads about this many bytes in total, so small uploads are repeated more often
+constexpr size_t TargetBytesPerCase = 256 * 1024 * 1024;
+constexpr size_t MinIterations = 3;
+constexpr size_t MaxIterations = 1000;
+
+const std::array<size_t, 5> buffer_sizes
+    = { 1024, 16 * 1024, 256 * 1024, 4 * 1024 * 1024, MaxUploadSize };
+const std::array<size_t, 5> texture_sizes = { 16, 64, 256, 1024, 4096 };
+
+struct Usage {
+    mugfx_buffer_usage_hint hint;
+    const char* name;
+};
+
+const std::array<Usage, 3> usages = {
+    Usage { MUGFX_BUFFER_USAGE_HINT_STATIC, "static" },
+    Usage { MUGFX_BUFFER_USAGE_HINT_DYNAMIC, "dynamic" },
+    Usage { MUGFX_BUFFER_USAGE_HINT_STREAM, "stream" },
+};
+
+struct Format {
+    mugfx_pixel_format format;
+    const char* name;
+    size_t bytes_per_pixel;
+};
+
+const std::array<Format, 4> formats = {
+    Format { MUGFX_PIXEL_FORMAT_RGBA8, "rgba8", 4 },
+    Format { MUGFX_PIXEL_FORMAT_RGB8, "rgb8", 3 },
+    Format { MUGFX_PIXEL_FORMAT_RGBA16F, "rgba16f", 8 },
+    Format { MUGFX_PIXEL_FORMAT_RGBA32F, "rgba32f", 16 },
+};
+
+const auto vert_source = R"(
+    #version 330 core
+
+    layout (location = 0) in vec4 a_position;
+
+    void main() {
+        gl_Position = a_position;
+    }
+)";
+
+const auto frag_source = R"(
+    #version 330 core
+
+    out vec4 frag_color;
+
+    void main() {
+        frag_color = vec4(1.0);
+    }
+)";
+
+size_t iterations(size_t bytes)
+{
+    return std::clamp(TargetBytesPerCase / bytes, MinIterations, MaxIterations);
+}
+
+void report_upload(JsonReport& report, const std::string& name, size_t bytes, size_t count,
+    const Stopwatch& sw)
+{
+    report.result(name.c_str());
+    report.value("bytes", bytes);
+    report.value("iterations", count);
+    report.value("mb_per_sec", static_cast<double>(bytes * count) / (sw.wall_ns() * 1e-9) / 1e6);
+    report.value("wall_us_per_call", sw.wall_ns() / count * 1e-3);
+    report.value("cpu_us_per_call", sw.cpu_ns() / count * 1e-3);
+}
+
+int main()
+{
+    const auto ctx = HeadlessContext::create(64, 64);
+
+    mugfx_init({
+        .logging_callback = bench_logger,
+        .panic_handler = bench_panic_handler,
+        .get_proc_address = HeadlessContext::get_proc_address,
+    });
+
+    JsonReport report("upload", ctx.renderer());
+
+    const std::vector<uint8_t> data(MaxUploadSize, 0x7F);
+
+    for (const auto& usage : usages) {
+        for (const auto size : buffer_sizes) {
+            const auto count = iterations(size);
+            const auto suffix = std::string("_") + usage.name + "_" + std::to_string(size);
+            const auto buffer = mugfx_buffer_create({
+                .target = MUGFX_BUFFER_TARGET_ARRAY,
+                .usage = usage.hint,
+                .data = { data.data(), size },
+            });
+
+            Stopwatch full;
+            full.start();
+            for (size_t i = 0; i < count; ++i) {
+                mugfx_buffer_set_data(buffer, { data.data(), size });
+            }
+            ctx.finish();
+            full.stop();
+            report_upload(report, "buffer_set_data_full" + suffix, size, count, full);
+
+            // mugfx_buffer_set_data always writes at offset 0, so this updates the first quarter
+            Stopwatch partial;
+            partial.start();
+            for (size_t i = 0; i < count; ++i) {
+                mugfx_buffer_set_data(buffer, { data.data(), size / 4 });
+            }
+            ctx.finish();
+            partial.stop();
+            report_upload(report, "buffer_set_data_partial" + suffix, size / 4, count, partial);
+
+            mugfx_buffer_destroy(buffer);
+        }
+    }
+
+    // The buffer is updated and drawn from every frame, so the driver has to synchronize with
+    // (or rename) the buffer the previous frame used
+    const auto vert_shader
+        = mugfx_shader_create({ .stage = MUGFX_SHADER_STAGE_VERTEX, .source = vert_source });
+    const auto frag_shader
+        = mugfx_shader_create({ .stage = MUGFX_SHADER_STAGE_FRAGMENT, .source = frag_source });
+    const auto material
+        = mugfx_material_create({ .vert_shader = vert_shader, .frag_shader = frag_shader });
+    mugfx_set_viewport(0, 0, 64, 64);
+    for (const auto& usage : usages) {
+        for (const auto size : buffer_sizes) {
+            const auto count = iterations(size);
+            const auto buffer = mugfx_buffer_create({
+                .target = MUGFX_BUFFER_TARGET_ARRAY,
+                .usage = usage.hint,
+                .data = { data.data(), size },
+            });
+            const auto geometry = mugfx_geometry_create({
+                .vertex_buffers = {
+                    {
+                        .buffer = buffer,
+                        .attributes = {
+                            { .location = 0, .components = 4,
+                                .type = MUGFX_VERTEX_ATTRIBUTE_TYPE_U8_NORM },
+                        },
+                    },
+                },
+                .vertex_count = 3,
+            });
+
+            Stopwatch streaming;
+            streaming.start();
+            for (size_t i = 0; i < count; ++i) {
+                mugfx_begin_frame();
+                mugfx_buffer_set_data(buffer, { data.data(), size });
+                mugfx_draw(material, geometry, nullptr, 0);
+                mugfx_end_frame();
+            }
+            ctx.finish();
+            streaming.stop();
+            const auto name
+                = std::string("buffer_streaming_") + usage.name + "_" + std::to_string(size);
+            report_upload(report, name, size, count, streaming);
+
+            mugfx_geometry_destroy(geometry);
+            mugfx_buffer_destroy(buffer);
+        }
+    }
+
+    for (const auto& format : formats) {
+        for (const auto dim : texture_sizes) {
+            const auto size = dim * dim * format.bytes_per_pixel;
+            if (size > MaxUploadSize) {
+                continue;
+            }
+            const auto count = iterations(size);
+            const auto suffix = std::string("_") + format.name + "_" + std::to_string(dim);
+            const mugfx_texture_create_params params {
+                .width = dim,
+                .height = dim,
+                .format = format.format,
+                .data = { data.data(), size },
+            };
+
+            Stopwatch create;
+            for (size_t i = 0; i < count; ++i) {
+                create.start();
+                const auto texture = mugfx_texture_create(params);
+                ctx.finish();
+                create.stop();
+                mugfx_texture_destroy(texture);
+            }
+            report_upload(report, "texture_create" + suffix, size, count, create);
+
+            const auto texture = mugfx_texture_create(params);
+            Stopwatch set_data;
+            set_data.start();
+            for (size_t i = 0; i < count; ++i) {
+                mugfx_texture_set_data(texture, { data.data(), size }, format.format);
+            }
+            ctx.finish();
+            set_data.stop();
+            report_upload(report, "texture_set_data" + suffix, size, count, set_data);
+            mugfx_texture_destroy(texture);
+        }
+    }
+
+    return 0;
+}
@@ -17,6 +17,7 @@ enum {
     MUGFX_MAX_COLOR_FORMATS = 8,
     MUGFX_MAX_SHADER_UNIFORM_DESCRIPTORS = 8,
     MUGFX_MAX_SHADER_SAMPLERS = 16,
+    MUGFX_MAX_DRAW_BINDINGS = 16,
 };
 
 typedef enum {
@@ -32,22 +33,102 @@ const char* mugfx_severity_to_string(mugfx_severity severity);
 
 typedef void (*mugfx_panic_handler)(const char* msg);
 
+// What an allocation is used for. The tag of an allocation never changes.
+typedef enum {
+    MUGFX_ALLOCATION_TAG_INTERNAL = 0, // everything else (profiler, tracing, log queue, etc.)
+    MUGFX_ALLOCATION_TAG_POOL, // resource pools (freed by mugfx_shutdown)
+    MUGFX_ALLOCATION_TAG_UNIFORM_DATA, // lives as long as its uniform data object
+    // Interned resource names (freed by mugfx_shutdown), shader info logs (freed right away) and
+    // replayed strings
+    MUGFX_ALLOCATION_TAG_STRING,
+    MUGFX_ALLOCATION_TAG_COMMAND_LIST, // grows while recording, lives as long as its command list
+    // Copies of data on their way to the render thread (the command buffer and data that does not
+    // fit into it). Data outside of the command buffer is freed as soon as it was executed.
+    MUGFX_ALLOCATION_TAG_STAGING,
+    MUGFX_ALLOCATION_TAG_MATERIAL, // uniform locations, live as long as their material
+    MUGFX_ALLOCATION_TAG_COUNT,
+} mugfx_allocation_tag;
+
 // https://nullprogram.com/blog/2023/12/17/
 typedef void* (*mugfx_allocator_allocate)(size_t size, void* ctx);
 typedef void* (*mugfx_allocator_reallocate)(void* ptr, size_t old_size, size_t new_size, void* ctx);
 typedef void (*mugfx_allocator_deallocate)(void* ptr, size_t size, void* ctx);
+typedef void* (*mugfx_allocator_allocate_tagged)(size_t size, mugfx_allocation_tag tag, void* ctx);
+typedef void* (*mugfx_allocator_reallocate_tagged)(
+    void* ptr, size_t old_size, size_t new_size, mugfx_allocation_tag tag, void* ctx);
+typedef void (*mugfx_allocator_deallocate_tagged)(
+    void* ptr, size_t size, mugfx_allocation_tag tag, void* ctx);
 
 typedef struct {
     mugfx_allocator_allocate allocate;
     mugfx_allocator_reallocate reallocate;
     mugfx_allocator_deallocate deallocate;
     void* ctx;
+    // Optional. If all three are set, they are called instead of the functions above, so
+    // allocations can be routed by tag (e.g. staging memory to a frame arena). Otherwise they are
+    // all ignored.
+    mugfx_allocator_allocate_tagged allocate_tagged;
+    mugfx_allocator_reallocate_tagged reallocate_tagged;
+    mugfx_allocator_deallocate_tagged deallocate_tagged;
 } mugfx_allocator;
 
+typedef void (*mugfx_render_thread_callback)(void* ctx);
+
+// In render thread mode, mugfx starts a thread that owns the context and executes the graphics API
+// calls. The thread calling mugfx_init (the game thread) only records them into a command buffer,
+// so frame N is rendered while the game thread works on frame N + 1. All functions (except the
+// command list recording functions) must then be called from the game thread.
+// Arguments are copied, so they can be freed after the call returns. Create functions return a
+// handle right away, but if creation fails later, the handle will simply never become valid.
+// The allocator and the logging callback must be thread-safe in this mode.
+typedef struct {
+    bool enabled;
+    // Called on the render thread before anything else. The context must not be current on any
+    // other thread.
+    mugfx_render_thread_callback make_current;
+    // optional, called on the render thread at the end of every frame, e.g. to swap buffers
+    mugfx_render_thread_callback present;
+    void* ctx; // passed to the callbacks
+    size_t command_buffer_size; // default: 16 MiB
+} mugfx_render_thread_params;
+
+// Estimated cost of a single state change, used to order the draws of reorder groups.
+// Scaling all weights by the same factor does not change the order.
+typedef struct {
+    float program; // default: 10
+    float vao; // default: 4
+    float texture; // default: 2, per texture unit
+    float state; // default: 1.5, per material change (blend, depth, etc.)
+    float uniforms; // default: 1, per uniform data upload
+} mugfx_state_change_costs;
+
+typedef void* (*mugfx_get_proc_address)(const char* name);
+
+// If `write` is set, every call is serialized into a binary capture, which can be replayed with
+// mugfx_replay_chunk (e.g. by the mugfx_replay tool) to reproduce a workload offline.
+// Captures are only valid for the same version and platform of mugfx.
+// The capture is passed to `write` in chunks, which are written at the end of every frame and when
+// they exceed chunk_size, so the capture can be streamed to a file. See mugfx_capture_chunk_header.
+typedef void (*mugfx_capture_write)(const void* data, size_t size, void* ctx);
+
+typedef struct {
+    mugfx_capture_write write;
+    void* ctx;
+    size_t chunk_size; // default: 1 MiB
+} mugfx_capture_params;
+
 typedef struct {
     mugfx_logging_callback logging_callback;
     mugfx_panic_handler panic_handler; // if set, mugfx will panic on error
-    mugfx_allocator* allocator; // default will use malloc
+    // Messages with a lower severity are dropped before they are formatted. default: DEBUG
+    mugfx_severity min_log_severity;
+    // If not 0, messages are not passed to logging_callback right away, but stored in a lock-free
+    // queue of this many messages, which is drained with mugfx_log_drain (e.g. on the game thread,
+    // so the render thread never waits for logging). Messages are dropped if the queue is full.
+    size_t log_queue_size;
+    // default will use malloc. Without an allocator, the pools only reserve address space for the
+    // max_num_* objects below and commit memory as the number of objects grows.
+    mugfx_allocator* allocator;
     size_t max_num_shaders; // default: 64
     size_t max_num_textures; // default: 128
     size_t max_num_uniforms; // default: 1024
@@ -56,8 +137,26 @@ typedef struct {
     size_t max_num_geometries; // default: 1024
     size_t max_num_render_targets; // default: 32
     size_t max_num_pipelines; // default: 1024
+    size_t max_num_draw_packets; // default: 1024
+    size_t max_num_binding_sets; // default: 1024
+    size_t max_num_command_lists; // default: 64
+    mugfx_render_thread_params render_thread;
+    mugfx_state_change_costs state_change_costs;
+    // Label objects with the `label` of their create params and insert the groups of
+    // mugfx_push_group, so they show up in graphics debuggers. If false, both cost nothing.
+    bool debug_labels;
+    // Count samples, primitives and shader invocations in GPU scopes (see mugfx_gpu_scope_timing).
+    // This needs additional queries, so it is off by default.
+    bool pipeline_statistics;
+    // OpenGL only, optional. Used to load functions that are not part of OpenGL 3.3, like the ones
+    // needed for debug_labels and the faster paths of mugfx_get_capabilities
+    // (e.g. SDL_GL_GetProcAddress).
+    mugfx_get_proc_address get_proc_address;
+    mugfx_capture_params capture;
 #ifdef MUGFX_OPENGL
     // We don't need anything here. Just create a context and make it current
+#elif MUGFX_NULL
+    // No context needed, nothing is rendered
 #elif MUGFX_VULKAN
     const void* device; // VkDevice
     const void* swapchain; // VkSwapchainKHR
@@ -66,6 +165,15 @@ typedef struct {
 
 void mugfx_init(mugfx_init_params params);
 
+// Passes all messages in the log queue (see mugfx_init_params.log_queue_size) to logging_callback
+// on the calling thread and returns their number. Does nothing without a log queue.
+size_t mugfx_log_drain();
+
+// Destroys all objects that were not destroyed yet (and logs them as leaks), stops the render
+// thread and frees everything mugfx allocated. The context has to stay current until this
+// returns. Afterwards mugfx_init may be called again, e.g. with different limits or a new context.
+void mugfx_shutdown();
+
 typedef struct {
     const void* data;
     size_t length;
@@ -151,6 +259,7 @@ typedef struct {
     const char* source;
     const mugfx_uniform_descriptor* uniform_descriptors[MUGFX_MAX_SHADER_UNIFORM_DESCRIPTORS];
     mugfx_shader_sampler samplers[MUGFX_MAX_SHADER_SAMPLERS];
+    const char* label; // optional, see mugfx_init_params.debug_labels
 } mugfx_shader_create_params;
 
 mugfx_shader_id mugfx_shader_create(mugfx_shader_create_params params);
@@ -210,6 +319,7 @@ typedef struct {
     bool generate_mipmaps;
     mugfx_slice data; // maybe optionally be set at creation
     mugfx_pixel_format data_format; // default: format
+    const char* label; // optional, see mugfx_init_params.debug_labels
 } mugfx_texture_create_params;
 
 mugfx_texture_id mugfx_texture_create(mugfx_texture_create_params params);
@@ -300,6 +410,7 @@ typedef struct {
     mugfx_stencil_func stencil_func; // default: ALWAYS
     int stencil_ref;
     uint32_t stencil_mask;
+    const char* label; // optional, see mugfx_init_params.debug_labels
 } mugfx_material_create_params;
 
 mugfx_material_id mugfx_material_create(mugfx_material_create_params params);
@@ -328,6 +439,7 @@ typedef struct {
     mugfx_buffer_target target; // default: ARRAY
     mugfx_buffer_usage_hint usage; // default: STATIC
     mugfx_slice data; // optional initial data
+    const char* label; // optional, see mugfx_init_params.debug_labels
 } mugfx_buffer_create_params;
 
 mugfx_buffer_id mugfx_buffer_create(mugfx_buffer_create_params params);
@@ -414,6 +526,7 @@ typedef struct {
     size_t index_buffer_offset;
     size_t vertex_count;
     size_t index_count;
+    const char* label; // optional, see mugfx_init_params.debug_labels
 } mugfx_geometry_create_params;
 
 // This represents the vertex input state of the pipeline
@@ -431,6 +544,7 @@ typedef struct {
     mugfx_pixel_format color_formats[MUGFX_MAX_COLOR_FORMATS]; // default is {RGBA8}
     mugfx_pixel_format depth_format; // default is DEPTH24
     size_t samples;
+    const char* label; // optional, see mugfx_init_params.debug_labels
 } mugfx_render_target_create_params;
 
 mugfx_render_target_id mugfx_render_target_create(mugfx_render_target_create_params params);
@@ -446,11 +560,16 @@ void mugfx_set_viewport(int x, int y, size_t width, size_t height);
 void mugfx_set_scissor(int x, int y, size_t width, size_t height);
 
 // Drawing
+typedef struct {
+    uint32_t id;
+} mugfx_binding_set_id;
+
 typedef enum {
     MUGFX_BINDING_TYPE_DEFAULT = 0,
     MUGFX_BINDING_TYPE_UNIFORM_DATA,
     MUGFX_BINDING_TYPE_TEXTURE,
     MUGFX_BINDING_TYPE_BUFFER,
+    MUGFX_BINDING_TYPE_BINDING_SET,
 } mugfx_binding_type;
 
 typedef struct {
@@ -468,22 +587,342 @@ typedef struct {
         mugfx_texture_id id;
     };
 
+    struct binding_set {
+        mugfx_binding_set_id id;
+    };
+
     mugfx_binding_type type;
     union {
         struct uniform_data uniform_data;
         struct buffer buffer;
         struct texture texture;
+        struct binding_set binding_set;
     };
 } mugfx_draw_binding;
 
+// Binding Set (maps to a Descriptor Set in Vulkan)
+typedef struct {
+    const mugfx_draw_binding* bindings; // binding sets can not be nested
+    size_t num_bindings; // at most MUGFX_MAX_DRAW_BINDINGS
+} mugfx_binding_set_create_params;
+
+// A binding set is an immutable group of bindings, which can be bound like a single binding.
+// If a set is used for consecutive draws, it is only applied again if something it bound has been
+// replaced in the meantime or the contents of its uniform data changed.
+// The referenced resources must outlive the binding set. Using a set whose resources were destroyed
+// logs an error and skips the draw.
+mugfx_binding_set_id mugfx_binding_set_create(mugfx_binding_set_create_params params);
+void mugfx_binding_set_destroy(mugfx_binding_set_id binding_set);
+
 void mugfx_begin_frame();
 void mugfx_draw(mugfx_material_id material, mugfx_geometry_id geometry,
     mugfx_draw_binding* bindings, size_t num_bindings);
 void mugfx_draw_instanced(mugfx_material_id material, mugfx_geometry_id geometry,
     mugfx_draw_binding* bindings, size_t num_bindings, size_t instance_count);
+
+// Draw Packet
+typedef struct {
+    uint32_t id;
+} mugfx_draw_packet_id;
+
+typedef struct {
+    mugfx_material_id material;
+    mugfx_geometry_id geometry;
+    const mugfx_draw_binding* bindings;
+    size_t num_bindings; // at most MUGFX_MAX_DRAW_BINDINGS
+} mugfx_draw_packet_create_params;
+
+// A draw packet validates and resolves everything mugfx_draw needs once, so submitting it skips all
+// lookups. The referenced resources must outlive the packet, but the contents of uniform data may
+// still change between submissions. Submitting a packet whose resources were destroyed logs an
+// error and skips it.
+mugfx_draw_packet_id mugfx_draw_packet_create(mugfx_draw_packet_create_params params);
+void mugfx_draw_packet_destroy(mugfx_draw_packet_id packet);
+void mugfx_draw_packets(const mugfx_draw_packet_id* packets, size_t num_packets);
+
+// Command List
+typedef struct {
+    uint32_t id;
+} mugfx_command_list_id;
+
+typedef struct {
+    size_t max_num_draws; // default: 1024
+    size_t max_num_bindings; // default: 4 * max_num_draws
+} mugfx_command_list_create_params;
+
+typedef struct {
+    mugfx_material_id material;
+    mugfx_geometry_id geometry;
+    const mugfx_draw_binding* bindings; // will be copied
+    size_t num_bindings; // at most MUGFX_MAX_DRAW_BINDINGS
+    size_t instance_count; // default: 1
+    uint64_t sort_key; // draws are ordered by this, if command lists are sorted on submission
+} mugfx_draw_command;
+
+// Command lists record draws without touching the graphics API or any shared state, so every list
+// can be recorded on a different thread. All storage is allocated on creation.
+// Command lists and other resources may be created and destroyed on other threads while lists are
+// recorded, but a list must not be destroyed, reset or submitted while it is being recorded.
+// The draws are only validated when the lists are submitted, which has to happen on the thread
+// that owns the context (the game thread in render thread mode). Submitting does not reset the
+// lists.
+mugfx_command_list_id mugfx_command_list_create(mugfx_command_list_create_params params);
+void mugfx_command_list_destroy(mugfx_command_list_id list);
+void mugfx_command_list_reset(mugfx_command_list_id list);
+void mugfx_command_list_draw(mugfx_command_list_id list, mugfx_draw_command command);
+// Draws of all lists are executed in the order given. If `sort` is true, they are stably sorted by
+// sort_key (across all lists) first.
+void mugfx_command_lists_submit(const mugfx_command_list_id* lists, size_t num_lists, bool sort);
+
+// Draw Reordering
+typedef struct {
+    uint64_t program;
+    uint64_t vao;
+    uint64_t texture;
+    uint64_t state;
+    uint64_t uniforms;
+} mugfx_state_change_counts;
+
+typedef struct {
+    size_t num_groups;
+    size_t num_draws;
+    mugfx_state_change_counts estimated_unordered; // in submission order
+    mugfx_state_change_counts estimated; // after reordering
+    mugfx_state_change_counts actual; // counted while the reordered draws were executed
+    float estimated_cost_unordered;
+    float estimated_cost;
+} mugfx_reorder_stats;
+
+// All draws (including draw packets and command lists) between begin and end are buffered and
+// executed in a different order when the group ends, to reduce the estimated cost of the state
+// changes between them (see mugfx_state_change_costs). The draws are sorted by state, most
+// expensive kind first, and then reordered greedily by estimated cost within small windows, so the
+// result is usually cheaper, but not the cheapest possible order. Draws with the same state keep
+// their order. Nothing the draws use may be modified before the group ends. Groups can not be
+// nested.
+void mugfx_reorder_group_begin();
+void mugfx_reorder_group_end();
+// Summed over all reorder groups of the last completed frame. Compare estimated and actual
+// changes to tune the costs for a driver.
+mugfx_reorder_stats mugfx_get_reorder_stats();
+
+// Frame Statistics
+typedef struct {
+    uint64_t draws;
+    uint64_t instances;
+    uint64_t triangles;
+    uint64_t program_binds;
+    uint64_t vao_binds;
+    uint64_t texture_binds;
+    uint64_t buffer_binds;
+    uint64_t bind_cache_hits; // binds that were skipped, because the object was already bound
+    uint64_t bind_cache_misses;
+    uint64_t uniform_calls; // glUniform* or equivalent
+    uint64_t uniform_bytes;
+    uint64_t texture_upload_bytes;
+    uint64_t buffer_upload_bytes;
+    uint64_t resources_created;
+    uint64_t resources_destroyed;
+} mugfx_frame_stats;
+
+// The counters are reset in mugfx_begin_frame. Returns the counters of the last completed frame.
+// If mugfx was built without MUGFX_ENABLE_FRAME_STATS, all counters are zero.
+mugfx_frame_stats mugfx_get_frame_stats();
+
+// GPU Profiling
+typedef struct {
+    const char* name;
+    uint32_t parent; // index of the enclosing scope, UINT32_MAX for top-level scopes
+    uint32_t depth;
+    uint64_t start_ns; // relative to the start of the first scope of the frame
+    uint64_t time_ns;
+    // Only counted if mugfx_init_params.pipeline_statistics is set, zero otherwise. Like time_ns,
+    // these include all child scopes.
+    uint64_t samples_passed; // samples that passed the depth and stencil tests
+    uint64_t primitives_generated;
+    // Need GL_ARB_pipeline_statistics_query (core since OpenGL 4.6), zero otherwise
+    uint64_t vertex_shader_invocations;
+    uint64_t fragment_shader_invocations;
+    uint64_t clipping_input_primitives;
+    uint64_t clipping_output_primitives; // less than the input, if primitives were clipped away
+} mugfx_gpu_scope_timing;
+
+// Measures the GPU time of everything between begin and end. Scopes can be nested, but have to be
+// closed in the frame they were opened in. `name` is interned, so it may be a temporary string and
+// the names returned with the timings stay valid until mugfx_shutdown.
+// Does nothing if the context does not support timestamp queries.
+void mugfx_gpu_scope_begin(const char* name);
+void mugfx_gpu_scope_end();
+// Copies at most `max_scopes` scopes of the latest frame with available results into `scopes`,
+// each followed by its children, and returns the total number of scopes of that frame.
+// Results are read back without stalling, so they lag a few frames behind. If `frame` is not
+// null, the number of the frame (counting mugfx_end_frame calls) is stored there.
+size_t mugfx_get_gpu_timings(mugfx_gpu_scope_timing* scopes, size_t max_scopes, uint64_t* frame);
+
+// Debug Groups
+// Groups nest and show up in graphics debuggers, if mugfx_init_params.debug_labels is set.
+void mugfx_push_group(const char* name);
+void mugfx_pop_group();
+
+// Overdraw Heatmap
+enum {
+    MUGFX_MAX_OVERDRAW = 32,
+};
+
+typedef struct {
+    bool enabled;
+    // Counts from 1 to max_overdraw get their own color and histogram entry. default: 8
+    uint32_t max_overdraw;
+    // Copy the heatmap to the default framebuffer in mugfx_end_frame, instead of the frame itself
+    bool present;
+} mugfx_overdraw_params;
+
+// A diagnostic mode that counts how often every pixel is shaded. While it is enabled, all draws
+// between mugfx_begin_frame and mugfx_end_frame go to an internal framebuffer with color writes
+// disabled, where every fragment that is not discarded increments the stencil value of its pixel.
+// mugfx_end_frame turns the counts into a heatmap (black for none, then blue over green to red).
+// Changes take effect at the next mugfx_begin_frame.
+void mugfx_set_overdraw_mode(mugfx_overdraw_params params);
+// An RGBA8 texture as large as the viewport (including its offset), which is updated in every
+// mugfx_end_frame while the mode is enabled. 0 if the mode was never enabled.
+mugfx_texture_id mugfx_get_overdraw_heatmap();
+
+typedef struct {
+    uint64_t frame; // number of the frame (counting mugfx_end_frame calls)
+    uint64_t pixels;
+    uint64_t covered_pixels; // shaded at least once
+    uint64_t fragments; // pixels shaded more than max_overdraw times only count max_overdraw times
+    float average_overdraw; // fragments per covered pixel
+    uint32_t max_overdraw; // the highest count (at most max_overdraw)
+    uint64_t histogram[MUGFX_MAX_OVERDRAW]; // number of pixels shaded at least i + 1 times
+} mugfx_overdraw_stats;
+
+// Statistics of the latest frame in overdraw mode with available results. Like GPU timings, they
+// are read back without stalling and lag a few frames behind.
+mugfx_overdraw_stats mugfx_get_overdraw_stats();
+
+// Memory Statistics
+typedef struct {
+    size_t count;
+    size_t high_water; // the highest count since mugfx_init
+    size_t capacity; // the corresponding max_num_* of mugfx_init_params
+    // Estimated. Textures and buffers use GPU memory, pools and uniform data use CPU memory.
+    size_t gpu_bytes;
+    size_t cpu_bytes;
+} mugfx_resource_memory;
+
+typedef struct {
+    size_t count; // live allocations
+    size_t bytes;
+    size_t peak_bytes;
+} mugfx_allocation_stats;
+
+typedef struct {
+    mugfx_resource_memory shaders;
+    mugfx_resource_memory textures;
+    mugfx_resource_memory materials;
+    mugfx_resource_memory buffers;
+    mugfx_resource_memory uniform_data;
+    mugfx_resource_memory geometries;
+    mugfx_resource_memory draw_packets;
+    mugfx_resource_memory binding_sets;
+    mugfx_resource_memory command_lists;
+    size_t gpu_bytes; // sum of the estimates above
+    // Everything currently allocated with mugfx_init_params::allocator (pools, uniform data,
+    // command lists, the render thread command buffer, etc.)
+    size_t cpu_bytes;
+    size_t cpu_bytes_peak;
+    mugfx_allocation_stats allocations[MUGFX_ALLOCATION_TAG_COUNT]; // cpu_bytes by tag
+    // Reported by the driver with GL_NVX_gpu_memory_info or GL_ATI_meminfo, updated in
+    // mugfx_end_frame. 0 if not available. GL_ATI_meminfo does not report the total.
+    size_t driver_total_bytes;
+    size_t driver_available_bytes;
+} mugfx_memory_stats;
+
+// Texture estimates include all mip levels. Drivers add padding and alignment, so the actual usage
+// is usually a bit higher.
+mugfx_memory_stats mugfx_get_memory_stats();
+
+// Capabilities
+typedef enum {
+    MUGFX_TEXTURE_BIND_PATH_BIND_TEXTURE = 0, // glActiveTexture + glBindTexture
+    MUGFX_TEXTURE_BIND_PATH_MULTI_BIND, // glBindTextures
+    MUGFX_TEXTURE_BIND_PATH_DSA, // glBindTextureUnit
+} mugfx_texture_bind_path;
+
+typedef enum {
+    MUGFX_BUFFER_STORAGE_PATH_BUFFER_DATA = 0, // glBufferData (mutable storage)
+    MUGFX_BUFFER_STORAGE_PATH_BUFFER_STORAGE, // glBufferStorage (immutable storage)
+} mugfx_buffer_storage_path;
+
+typedef struct {
+    int gl_major;
+    int gl_minor;
+    bool gles;
+    // Supported by the context, either because they are core in its version or as an extension
+    bool direct_state_access; // GL 4.5, ARB_direct_state_access
+    bool buffer_storage; // GL 4.4, ARB_buffer_storage, EXT_buffer_storage
+    bool multi_bind; // GL 4.4, ARB_multi_bind
+    bool multi_draw_indirect; // GL 4.3, ARB_multi_draw_indirect, EXT_multi_draw_indirect
+    bool parallel_shader_compile; // KHR_parallel_shader_compile, ARB_parallel_shader_compile
+    bool texture_compression_s3tc; // EXT_texture_compression_s3tc
+    bool texture_compression_bptc; // GL 4.2, ARB_texture_compression_bptc
+    bool texture_compression_etc2; // GL 4.3, GLES 3.0, ARB_ES3_compatibility
+    bool texture_compression_astc; // KHR_texture_compression_astc_ldr
+    size_t uniform_buffer_offset_alignment;
+    size_t max_uniform_buffer_bindings;
+    size_t max_texture_units; // combined over all stages
+    size_t max_vertex_attributes;
+    // The fastest path of each kind that the context supports. Paths that need functions beyond
+    // OpenGL 3.3 are only selected if mugfx_init_params::get_proc_address is set.
+    mugfx_texture_bind_path texture_bind_path;
+    mugfx_buffer_storage_path buffer_storage_path;
+    bool shader_compiler_threads; // glMaxShaderCompilerThreadsKHR was used to enable all threads
+} mugfx_capabilities;
+
+// Probed in mugfx_init. With a render thread, this is all zeros until the render thread ran
+// mugfx_init.
+mugfx_capabilities mugfx_get_capabilities();
+
+// CPU Tracing
+// If built with MUGFX_ENABLE_TRACING, every public function and a few internal hot spots are timed
+// into a ring buffer per thread (the most recent 65536 events each). Timestamps are taken from
+// std::chrono::steady_clock, so they can be merged with other traces using the same clock.
+typedef void (*mugfx_trace_write)(const char* data, size_t size, void* ctx);
+// Writes all events recorded since the last dump as Chrome trace event JSON (load it in Perfetto or
+// chrome://tracing). `write` is called multiple times with consecutive chunks of the JSON.
+// Without tracing compiled in, this writes an empty trace.
+void mugfx_trace_dump(mugfx_trace_write write, void* ctx);
+
+// Capture Replay
+enum {
+    MUGFX_CAPTURE_MAGIC = 0x4350474D, // "MGPC"
+    MUGFX_CAPTURE_VERSION = 1,
+};
+
+// Every chunk starts with this header, followed by `size` bytes of serialized calls
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;
+    uint64_t frame; // number of frames that ended before the first call in this chunk
+} mugfx_capture_chunk_header;
+
+// Executes the calls of a single chunk (including its header). Chunks have to be replayed in order,
+// starting with the first one, which contains mugfx_init. mugfx_init is called with the captured
+// limits, but everything else (callbacks, allocator, render thread, capture) is taken from
+// `init_params`. Resources are not remapped, so the replay has to start with a fresh mugfx.
+// Command lists are replayed as the individual draws they submitted.
+// Returns false if the chunk is invalid.
+bool mugfx_replay_chunk(const void* chunk, size_t size, const mugfx_init_params* init_params);
+
 void mugfx_flush();
 void mugfx_end_frame();
 
+// In render thread mode this blocks until the render thread executed all previous calls, otherwise
+// it does nothing. mugfx_end_frame blocks until the previous frame is finished anyway.
+void mugfx_sync();
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
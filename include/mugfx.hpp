@@ -25,6 +25,8 @@ struct Allocator {
 struct InitParams {
     LoggingCallback* logging_callback = nullptr;
     PanicHandler* panic_handler = nullptr;
+    Severity min_log_severity = Severity::Debug;
+    size_t log_queue_size = 0;
     Allocator* allocator = nullptr;
     size_t max_num_shaders = 64;
     size_t max_num_textures = 128;
@@ -34,8 +36,35 @@ struct InitParams {
     size_t max_num_geometries = 1024;
     size_t max_num_render_targets = 32;
     size_t max_num_pipelines = 1024;
+    size_t max_num_draw_packets = 1024;
+    size_t max_num_binding_sets = 1024;
+    size_t max_num_command_lists = 64;
+    struct RenderThread {
+        bool enabled = false;
+        void (*make_current)(void* ctx) = nullptr;
+        void (*present)(void* ctx) = nullptr;
+        void* ctx = nullptr;
+        size_t command_buffer_size = 16 * 1024 * 1024;
+    } render_thread;
+    struct StateChangeCosts {
+        float program = 10.0f;
+        float vao = 4.0f;
+        float texture = 2.0f;
+        float state = 1.5f;
+        float uniforms = 1.0f;
+    } state_change_costs;
+    bool debug_labels = false;
+    bool pipeline_statistics = false;
+    void* (*get_proc_address)(const char* name) = nullptr;
+    struct Capture {
+        void (*write)(const void* data, size_t size, void* ctx) = nullptr;
+        void* ctx = nullptr;
+        size_t chunk_size = 1024 * 1024;
+    } capture;
 #ifdef MUGFX_OPENGL
     // We don't need anything here. Just create a context and make it current
+#elif MUGFX_NULL
+    // No context needed, nothing is rendered
 #elif MUGFX_VULKAN
     const void* device; // VkDevice
     const void* swapchain; // VkSwapchainKHR
@@ -45,6 +74,7 @@ struct InitParams {
 };
 
 void init(const InitParams& params);
+void shutdown();
 
 struct Id {
     uint32_t id = 0;
@@ -0,0 +1,688 @@
+#include "capture.hpp"
+
+#include <cstring>
+
+#include "render_thread.hpp"
+#include "shared.hpp"
+
+namespace {
+constexpr size_t align8(size_t v)
+{
+    return (v + 7) & ~size_t(7);
+}
+
+constexpr uint64_t NullLength = UINT64_MAX;
+
+// Only the game thread (or the thread owning the context) records, so this needs no lock
+struct CaptureState {
+    mugfx_capture_params params = {};
+    bool active = false;
+    Vector<uint8_t, MUGFX_ALLOCATION_TAG_STAGING> chunk; // starts with a mugfx_capture_chunk_header
+    size_t record_start = 0;
+    uint64_t frame = 0;
+};
+
+CaptureState& get_capture_state()
+{
+    static CaptureState state;
+    return state;
+}
+
+void begin_chunk(CaptureState& state)
+{
+    state.chunk.clear();
+    const mugfx_capture_chunk_header header {
+        .magic = MUGFX_CAPTURE_MAGIC,
+        .version = MUGFX_CAPTURE_VERSION,
+        .size = 0,
+        .frame = state.frame,
+    };
+    state.chunk.append(reinterpret_cast<const uint8_t*>(&header), sizeof(header));
+}
+
+void flush_chunk(CaptureState& state)
+{
+    if (state.chunk.size() <= sizeof(mugfx_capture_chunk_header)) {
+        return;
+    }
+    auto header = reinterpret_cast<mugfx_capture_chunk_header*>(state.chunk.data());
+    header->size = state.chunk.size() - sizeof(mugfx_capture_chunk_header);
+    state.params.write(state.chunk.data(), state.chunk.size(), state.params.ctx);
+    begin_chunk(state);
+}
+}
+
+int& capture_depth()
+{
+    thread_local int depth = 0;
+    return depth;
+}
+
+void capture_begin(const mugfx_capture_params& params)
+{
+    auto& state = get_capture_state();
+    state.params = params;
+    state.active = params.write != nullptr;
+    if (state.active) {
+        state.chunk.reserve(params.chunk_size);
+        begin_chunk(state);
+    }
+}
+
+void capture_end()
+{
+    auto& state = get_capture_state();
+    if (state.active) {
+        flush_chunk(state);
+    }
+    state.active = false;
+    state.chunk = {};
+}
+
+bool capture_enabled()
+{
+    return get_capture_state().active && capture_depth() == 0 && !is_render_thread();
+}
+
+void capture_record_begin(CaptureCall call)
+{
+    auto& state = get_capture_state();
+    state.record_start = state.chunk.size();
+    const CaptureRecordHeader header { call, 0, 0 };
+    state.chunk.append(reinterpret_cast<const uint8_t*>(&header), sizeof(header));
+}
+
+void capture_record_end()
+{
+    auto& state = get_capture_state();
+    auto header = reinterpret_cast<CaptureRecordHeader*>(state.chunk.data() + state.record_start);
+    const auto size = state.chunk.size() - state.record_start - sizeof(CaptureRecordHeader);
+    assert(size <= UINT32_MAX);
+    header->size = static_cast<uint32_t>(size);
+    if (header->call == CaptureCall::EndFrame) {
+        state.frame++;
+        flush_chunk(state);
+    } else if (state.chunk.size() >= state.params.chunk_size) {
+        flush_chunk(state);
+    }
+}
+
+void capture_write_raw(const void* data, size_t size)
+{
+    auto& chunk = get_capture_state().chunk;
+    chunk.append(reinterpret_cast<const uint8_t*>(data), size);
+    static constexpr std::array<uint8_t, 8> padding = {};
+    chunk.append(padding.data(), align8(size) - size);
+}
+
+void capture_write(const char* str)
+{
+    const uint64_t length = str ? std::strlen(str) + 1 : NullLength;
+    capture_write(length);
+    if (str) {
+        capture_write_raw(str, length);
+    }
+}
+
+void capture_write(mugfx_slice slice)
+{
+    const uint64_t length = slice.data ? slice.length : NullLength;
+    capture_write(length);
+    if (slice.data) {
+        capture_write_raw(slice.data, slice.length);
+    } else {
+        capture_write(static_cast<uint64_t>(slice.length));
+    }
+}
+
+// The pointer identifies the descriptor, because uniform data has to use the same descriptor as
+// the shader
+void capture_write(const mugfx_uniform_descriptor* descriptor)
+{
+    capture_write(reinterpret_cast<uintptr_t>(descriptor));
+    if (descriptor) {
+        capture_write_raw(descriptor, sizeof(mugfx_uniform_descriptor));
+        for (const auto& uniform : descriptor->uniforms) {
+            capture_write(uniform.name);
+        }
+    }
+}
+
+// Function pointers and the allocator are replaced on replay
+void capture_write(const mugfx_init_params& params)
+{
+    capture_write_raw(&params, sizeof(params));
+}
+
+void capture_write(const mugfx_shader_create_params& params)
+{
+    capture_write_raw(&params, sizeof(params));
+    capture_write(params.source);
+    for (const auto descriptor : params.uniform_descriptors) {
+        capture_write(descriptor);
+    }
+    for (const auto& sampler : params.samplers) {
+        capture_write(sampler.name);
+    }
+    capture_write(params.label);
+}
+
+void capture_write(const mugfx_texture_create_params& params)
+{
+    capture_write_raw(&params, sizeof(params));
+    capture_write(params.data);
+    capture_write(params.label);
+}
+
+void capture_write(const mugfx_material_create_params& params)
+{
+    capture_write_raw(&params, sizeof(params));
+    capture_write(params.label);
+}
+
+void capture_write(const mugfx_buffer_create_params& params)
+{
+    capture_write_raw(&params, sizeof(params));
+    capture_write(params.data);
+    capture_write(params.label);
+}
+
+void capture_write(const mugfx_uniform_data_create_params& params)
+{
+    capture_write_raw(&params, sizeof(params));
+    capture_write(params.descriptor);
+}
+
+void capture_write(const mugfx_geometry_create_params& params)
+{
+    capture_write_raw(&params, sizeof(params));
+    capture_write(params.label);
+}
+
+void capture_write(const mugfx_binding_set_create_params& params)
+{
+    capture_write_raw(&params, sizeof(params));
+    capture_write(CaptureArray<mugfx_draw_binding> { params.bindings, params.num_bindings });
+}
+
+void capture_write(const mugfx_draw_packet_create_params& params)
+{
+    capture_write_raw(&params, sizeof(params));
+    capture_write(CaptureArray<mugfx_draw_binding> { params.bindings, params.num_bindings });
+}
+
+namespace {
+struct ReplayDescriptor {
+    uintptr_t captured; // the pointer in the captured process
+    mugfx_uniform_descriptor descriptor;
+    std::array<StackString<>, MUGFX_MAX_UNIFORMS> names;
+};
+
+// Shaders and uniform data keep pointers to descriptors and GPU scopes keep their names, so these
+// live as long as the process.
+struct ReplayState {
+    Vector<ReplayDescriptor*> descriptors;
+    Vector<char*> strings;
+};
+
+ReplayState& get_replay_state()
+{
+    static ReplayState state;
+    return state;
+}
+
+bool same_descriptor(const ReplayDescriptor& a, const ReplayDescriptor& b)
+{
+    if (a.captured != b.captured || a.descriptor.usage_hint != b.descriptor.usage_hint
+        || a.descriptor.size != b.descriptor.size || a.descriptor.binding != b.descriptor.binding) {
+        return false;
+    }
+    for (size_t i = 0; i < MUGFX_MAX_UNIFORMS; ++i) {
+        const auto& ua = a.descriptor.uniforms[i];
+        const auto& ub = b.descriptor.uniforms[i];
+        if (ua.type != ub.type || ua.array_size != ub.array_size || ua.offset != ub.offset
+            || (ua.name == nullptr) != (ub.name == nullptr) || !(a.names[i] == b.names[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const char* persistent_string(const char* str)
+{
+    if (!str) {
+        return nullptr;
+    }
+    auto& strings = get_replay_state().strings;
+    for (const auto s : strings) {
+        if (std::strcmp(s, str) == 0) {
+            return s;
+        }
+    }
+    const auto size = std::strlen(str) + 1;
+    const auto copy = reinterpret_cast<char*>(allocate(size, MUGFX_ALLOCATION_TAG_STRING));
+    std::memcpy(copy, str, size);
+    strings.push_back(copy);
+    return copy;
+}
+
+// Reads the arguments of a single record. Everything is read in place, so the pointers are only
+// valid while the chunk is.
+class CaptureReader {
+public:
+    CaptureReader(const uint8_t* data, size_t size) : data_(data), size_(size) { }
+
+    bool ok() const { return ok_; }
+
+    template <typename T>
+    T read()
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value = {};
+        if (const auto src = take(sizeof(T))) {
+            std::memcpy(&value, src, sizeof(T));
+        }
+        return value;
+    }
+
+    const char* read_string()
+    {
+        const auto length = read<uint64_t>();
+        if (length == NullLength) {
+            return nullptr;
+        }
+        const auto str = reinterpret_cast<const char*>(take(length));
+        if (!str || length == 0 || str[length - 1] != '\0') {
+            ok_ = false;
+            return nullptr;
+        }
+        return str;
+    }
+
+    mugfx_slice read_slice()
+    {
+        const auto length = read<uint64_t>();
+        if (length == NullLength) {
+            return { nullptr, read<uint64_t>() };
+        }
+        return { take(length), length };
+    }
+
+    template <typename T>
+    const T* read_array(size_t& count)
+    {
+        static_assert(alignof(T) <= 8);
+        count = read<uint64_t>();
+        if (count > size_ / sizeof(T)) {
+            ok_ = false;
+            return nullptr;
+        }
+        return count ? reinterpret_cast<const T*>(take(sizeof(T) * count)) : nullptr;
+    }
+
+    const mugfx_uniform_descriptor* read_descriptor()
+    {
+        ReplayDescriptor desc = {};
+        desc.captured = read<uintptr_t>();
+        if (!desc.captured) {
+            return nullptr;
+        }
+        desc.descriptor = read<mugfx_uniform_descriptor>();
+        for (size_t i = 0; i < MUGFX_MAX_UNIFORMS; ++i) {
+            const auto name = StackString<>::create(read_string());
+            if (!name) {
+                ok_ = false;
+                return nullptr;
+            }
+            desc.names[i] = *name;
+        }
+
+        // If the application reused the memory of a descriptor for a different one, it is new
+        auto& descriptors = get_replay_state().descriptors;
+        for (const auto d : descriptors) {
+            if (same_descriptor(*d, desc)) {
+                return &d->descriptor;
+            }
+        }
+        auto d = reinterpret_cast<ReplayDescriptor*>(
+            allocate(sizeof(ReplayDescriptor), MUGFX_ALLOCATION_TAG_INTERNAL));
+        new (d) ReplayDescriptor(desc);
+        for (size_t i = 0; i < MUGFX_MAX_UNIFORMS; ++i) {
+            if (d->descriptor.uniforms[i].name) {
+                d->descriptor.uniforms[i].name = d->names[i].c_str();
+            }
+        }
+        descriptors.push_back(d);
+        return &d->descriptor;
+    }
+
+private:
+    const uint8_t* take(size_t size)
+    {
+        if (!ok_ || size > size_ - pos_ || align8(size) > size_ - pos_) {
+            ok_ = false;
+            return nullptr;
+        }
+        const auto ptr = data_ + pos_;
+        pos_ += align8(size);
+        return ptr;
+    }
+
+    const uint8_t* data_;
+    size_t size_;
+    size_t pos_ = 0;
+    bool ok_ = true;
+};
+
+void replay_init(CaptureReader& r, const mugfx_init_params* init_params)
+{
+    auto params = r.read<mugfx_init_params>();
+    const auto overrides = init_params ? *init_params : mugfx_init_params {};
+    params.logging_callback = overrides.logging_callback;
+    params.panic_handler = overrides.panic_handler;
+    params.min_log_severity = overrides.min_log_severity;
+    params.log_queue_size = overrides.log_queue_size;
+    params.allocator = overrides.allocator;
+    params.render_thread = overrides.render_thread;
+    params.get_proc_address = overrides.get_proc_address;
+    params.capture = overrides.capture;
+    if (r.ok()) {
+        mugfx_init(params);
+    }
+}
+
+bool replay_record(CaptureCall call, CaptureReader& r, const mugfx_init_params* init_params)
+{
+    switch (call) {
+    case CaptureCall::Init:
+        replay_init(r, init_params);
+        return r.ok();
+    case CaptureCall::ShaderCreate: {
+        auto params = r.read<mugfx_shader_create_params>();
+        params.source = r.read_string();
+        for (auto& descriptor : params.uniform_descriptors) {
+            descriptor = r.read_descriptor();
+        }
+        for (auto& sampler : params.samplers) {
+            sampler.name = r.read_string();
+        }
+        params.label = r.read_string();
+        if (r.ok()) {
+            mugfx_shader_create(params);
+        }
+        return r.ok();
+    }
+    case CaptureCall::ShaderDestroy: {
+        const auto shader = r.read<mugfx_shader_id>();
+        if (r.ok()) {
+            mugfx_shader_destroy(shader);
+        }
+        return r.ok();
+    }
+    case CaptureCall::TextureCreate: {
+        auto params = r.read<mugfx_texture_create_params>();
+        params.data = r.read_slice();
+        params.label = r.read_string();
+        if (r.ok()) {
+            mugfx_texture_create(params);
+        }
+        return r.ok();
+    }
+    case CaptureCall::TextureSetData: {
+        const auto texture = r.read<mugfx_texture_id>();
+        const auto data = r.read_slice();
+        const auto data_format = r.read<mugfx_pixel_format>();
+        if (r.ok()) {
+            mugfx_texture_set_data(texture, data, data_format);
+        }
+        return r.ok();
+    }
+    case CaptureCall::TextureDestroy: {
+        const auto texture = r.read<mugfx_texture_id>();
+        if (r.ok()) {
+            mugfx_texture_destroy(texture);
+        }
+        return r.ok();
+    }
+    case CaptureCall::MaterialCreate: {
+        auto params = r.read<mugfx_material_create_params>();
+        params.label = r.read_string();
+        if (r.ok()) {
+            mugfx_material_create(params);
+        }
+        return r.ok();
+    }
+    case CaptureCall::MaterialDestroy: {
+        const auto material = r.read<mugfx_material_id>();
+        if (r.ok()) {
+            mugfx_material_destroy(material);
+        }
+        return r.ok();
+    }
+    case CaptureCall::BufferCreate: {
+        auto params = r.read<mugfx_buffer_create_params>();
+        params.data = r.read_slice();
+        params.label = r.read_string();
+        if (r.ok()) {
+            mugfx_buffer_create(params);
+        }
+        return r.ok();
+    }
+    case CaptureCall::BufferSetData: {
+        const auto buffer = r.read<mugfx_buffer_id>();
+        const auto data = r.read_slice();
+        if (r.ok()) {
+            mugfx_buffer_set_data(buffer, data);
+        }
+        return r.ok();
+    }
+    case CaptureCall::BufferDestroy: {
+        const auto buffer = r.read<mugfx_buffer_id>();
+        if (r.ok()) {
+            mugfx_buffer_destroy(buffer);
+        }
+        return r.ok();
+    }
+    case CaptureCall::UniformDataCreate: {
+        auto params = r.read<mugfx_uniform_data_create_params>();
+        params.descriptor = r.read_descriptor();
+        if (r.ok()) {
+            mugfx_uniform_data_create(params);
+        }
+        return r.ok();
+    }
+    case CaptureCall::UniformDataSetFloat: {
+        const auto uniform_data = r.read<mugfx_uniform_data_id>();
+        const auto name = r.read_string();
+        const auto data = r.read_slice();
+        if (r.ok()) {
+            mugfx_uniform_data_set_float(uniform_data, name, data);
+        }
+        return r.ok();
+    }
+    case CaptureCall::UniformDataSetTexture: {
+        const auto uniform_data = r.read<mugfx_uniform_data_id>();
+        const auto name = r.read_string();
+        const auto texture = r.read<mugfx_texture_id>();
+        if (r.ok()) {
+            mugfx_uniform_data_set_texture(uniform_data, name, texture);
+        }
+        return r.ok();
+    }
+    case CaptureCall::UniformDataDestroy: {
+        const auto uniform_data = r.read<mugfx_uniform_data_id>();
+        if (r.ok()) {
+            mugfx_uniform_data_destroy(uniform_data);
+        }
+        return r.ok();
+    }
+    case CaptureCall::GeometryCreate: {
+        auto params = r.read<mugfx_geometry_create_params>();
+        params.label = r.read_string();
+        if (r.ok()) {
+            mugfx_geometry_create(params);
+        }
+        return r.ok();
+    }
+    case CaptureCall::GeometryDestroy: {
+        const auto geometry = r.read<mugfx_geometry_id>();
+        if (r.ok()) {
+            mugfx_geometry_destroy(geometry);
+        }
+        return r.ok();
+    }
+    case CaptureCall::SetViewport: {
+        const auto x = r.read<int>();
+        const auto y = r.read<int>();
+        const auto width = r.read<size_t>();
+        const auto height = r.read<size_t>();
+        if (r.ok()) {
+            mugfx_set_viewport(x, y, width, height);
+        }
+        return r.ok();
+    }
+    case CaptureCall::BindingSetCreate: {
+        auto params = r.read<mugfx_binding_set_create_params>();
+        params.bindings = r.read_array<mugfx_draw_binding>(params.num_bindings);
+        if (r.ok()) {
+            mugfx_binding_set_create(params);
+        }
+        return r.ok();
+    }
+    case CaptureCall::BindingSetDestroy: {
+        const auto binding_set = r.read<mugfx_binding_set_id>();
+        if (r.ok()) {
+            mugfx_binding_set_destroy(binding_set);
+        }
+        return r.ok();
+    }
+    case CaptureCall::BeginFrame:
+        mugfx_begin_frame();
+        return true;
+    case CaptureCall::Draw:
+    case CaptureCall::DrawInstanced: {
+        const auto material = r.read<mugfx_material_id>();
+        const auto geometry = r.read<mugfx_geometry_id>();
+        size_t num_bindings = 0;
+        const auto bindings = r.read_array<mugfx_draw_binding>(num_bindings);
+        const auto instance_count = call == CaptureCall::Draw ? 1 : r.read<size_t>();
+        if (r.ok()) {
+            // The bindings are not modified
+            mugfx_draw_instanced(material, geometry, const_cast<mugfx_draw_binding*>(bindings),
+                num_bindings, instance_count);
+        }
+        return r.ok();
+    }
+    case CaptureCall::DrawPacketCreate: {
+        auto params = r.read<mugfx_draw_packet_create_params>();
+        params.bindings = r.read_array<mugfx_draw_binding>(params.num_bindings);
+        if (r.ok()) {
+            mugfx_draw_packet_create(params);
+        }
+        return r.ok();
+    }
+    case CaptureCall::DrawPacketDestroy: {
+        const auto packet = r.read<mugfx_draw_packet_id>();
+        if (r.ok()) {
+            mugfx_draw_packet_destroy(packet);
+        }
+        return r.ok();
+    }
+    case CaptureCall::DrawPackets: {
+        size_t num_packets = 0;
+        const auto packets = r.read_array<mugfx_draw_packet_id>(num_packets);
+        if (r.ok()) {
+            mugfx_draw_packets(packets, num_packets);
+        }
+        return r.ok();
+    }
+    case CaptureCall::ReorderGroupBegin:
+        mugfx_reorder_group_begin();
+        return true;
+    case CaptureCall::ReorderGroupEnd:
+        mugfx_reorder_group_end();
+        return true;
+    case CaptureCall::GpuScopeBegin: {
+        const auto name = r.read_string();
+        if (r.ok()) {
+            mugfx_gpu_scope_begin(persistent_string(name));
+        }
+        return r.ok();
+    }
+    case CaptureCall::GpuScopeEnd:
+        mugfx_gpu_scope_end();
+        return true;
+    case CaptureCall::PushGroup: {
+        const auto name = r.read_string();
+        if (r.ok()) {
+            mugfx_push_group(name);
+        }
+        return r.ok();
+    }
+    case CaptureCall::PopGroup:
+        mugfx_pop_group();
+        return true;
+    case CaptureCall::Flush:
+        mugfx_flush();
+        return true;
+    case CaptureCall::EndFrame:
+        mugfx_end_frame();
+        return true;
+    case CaptureCall::SetOverdrawMode: {
+        const auto params = r.read<mugfx_overdraw_params>();
+        if (r.ok()) {
+            mugfx_set_overdraw_mode(params);
+        }
+        return r.ok();
+    }
+    case CaptureCall::Shutdown:
+        mugfx_shutdown();
+        return true;
+    default:
+        return false;
+    }
+}
+}
+
+EXPORT bool mugfx_replay_chunk(const void* chunk, size_t size, const mugfx_init_params* init_params)
+{
+    const auto data = reinterpret_cast<const uint8_t*>(chunk);
+    if (reinterpret_cast<uintptr_t>(data) % 8 != 0) {
+        // log_error needs mugfx_init, which might not have been replayed yet
+        if (init_params && init_params->logging_callback) {
+            init_params->logging_callback(MUGFX_SEVERITY_ERROR, "Chunk must be 8-byte aligned");
+        }
+        return false;
+    }
+
+    mugfx_capture_chunk_header header;
+    if (size < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (header.magic != MUGFX_CAPTURE_MAGIC || header.version != MUGFX_CAPTURE_VERSION
+        || header.size > size - sizeof(header)) {
+        return false;
+    }
+
+    size_t pos = sizeof(header);
+    const auto end = sizeof(header) + header.size;
+    while (pos < end) {
+        CaptureRecordHeader record;
+        if (end - pos < sizeof(record)) {
+            return false;
+        }
+        std::memcpy(&record, data + pos, sizeof(record));
+        pos += sizeof(record);
+        if (record.size > end - pos) {
+            return false;
+        }
+        CaptureReader reader(data + pos, record.size);
+        if (!replay_record(record.call, reader, init_params)) {
+            log_error("Invalid capture record (call %u)", static_cast<unsigned>(record.call));
+            return false;
+        }
+        pos += align8(record.size);
+    }
+    return true;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+#include "mugfx.h"
+
+// A capture is a sequence of chunks (mugfx_capture_chunk_header + records). Every record is a
+// CaptureRecordHeader followed by the arguments of the call. Every argument is padded to 8 bytes,
+// so the replay can read arrays of structs in place. Structs are written as they are in memory and
+// everything they point to follows them, so the replay only has to patch the pointers.
+
+enum class CaptureCall : uint16_t {
+    Init = 1,
+    ShaderCreate,
+    ShaderDestroy,
+    TextureCreate,
+    TextureSetData,
+    TextureDestroy,
+    MaterialCreate,
+    MaterialDestroy,
+    BufferCreate,
+    BufferSetData,
+    BufferDestroy,
+    UniformDataCreate,
+    UniformDataSetFloat,
+    UniformDataSetTexture,
+    UniformDataDestroy,
+    GeometryCreate,
+    GeometryDestroy,
+    SetViewport,
+    BindingSetCreate,
+    BindingSetDestroy,
+    BeginFrame,
+    Draw,
+    DrawInstanced,
+    DrawPacketCreate,
+    DrawPacketDestroy,
+    DrawPackets,
+    ReorderGroupBegin,
+    ReorderGroupEnd,
+    GpuScopeBegin,
+    GpuScopeEnd,
+    PushGroup,
+    PopGroup,
+    Flush,
+    EndFrame,
+    SetOverdrawMode,
+    Shutdown,
+};
+
+struct CaptureRecordHeader {
+    CaptureCall call;
+    uint16_t padding;
+    uint32_t size; // of the arguments following the header
+};
+static_assert(sizeof(CaptureRecordHeader) == 8);
+
+template <typename T>
+struct CaptureArray {
+    const T* data;
+    size_t count;
+};
+
+void capture_begin(const mugfx_capture_params& params);
+// Writes the last chunk and frees the capture buffer
+void capture_end();
+// True if calls on this thread are recorded right now
+bool capture_enabled();
+
+void capture_record_begin(CaptureCall call);
+void capture_record_end();
+
+void capture_write_raw(const void* data, size_t size);
+void capture_write(const char* str);
+void capture_write(mugfx_slice slice);
+void capture_write(const mugfx_uniform_descriptor* descriptor);
+void capture_write(const mugfx_init_params& params);
+void capture_write(const mugfx_shader_create_params& params);
+void capture_write(const mugfx_texture_create_params& params);
+void capture_write(const mugfx_material_create_params& params);
+void capture_write(const mugfx_buffer_create_params& params);
+void capture_write(const mugfx_uniform_data_create_params& params);
+void capture_write(const mugfx_geometry_create_params& params);
+void capture_write(const mugfx_binding_set_create_params& params);
+void capture_write(const mugfx_draw_packet_create_params& params);
+
+// Everything else must not contain pointers
+template <typename T>
+void capture_write(const T& value)
+{
+    static_assert(std::is_trivially_copyable_v<T> && !std::is_pointer_v<T>);
+    capture_write_raw(&value, sizeof(T));
+}
+
+template <typename T>
+void capture_write(CaptureArray<T> array)
+{
+    capture_write(array.count);
+    capture_write_raw(array.data, sizeof(T) * array.count);
+}
+
+template <typename... Args>
+void capture(CaptureCall call, const Args&... args)
+{
+    capture_record_begin(call);
+    (capture_write(args), ...);
+    capture_record_end();
+}
+
+int& capture_depth();
+
+// Records a call of a public function. Public functions called by other public functions (or on
+// the render thread) are not recorded, because the replay calls them again anyway.
+class CaptureScope {
+public:
+    template <typename... Args>
+    CaptureScope(CaptureCall call, const Args&... args)
+    {
+        if (capture_enabled()) {
+            capture(call, args...);
+        }
+        capture_depth()++;
+    }
+
+    ~CaptureScope() { capture_depth()--; }
+
+    CaptureScope(const CaptureScope&) = delete;
+    CaptureScope& operator=(const CaptureScope&) = delete;
+};
+
+#define CAPTURE(...) CaptureScope capture_scope(__VA_ARGS__)
@@ -0,0 +1,187 @@
+// Replaces glad for the Null backend: the OpenGL backend is compiled as usual, but every GL
+// function it calls is a stub that does nothing. This keeps all validation and bookkeeping of mugfx
+// and removes the driver, so mugfx's own overhead can be measured without a GPU or a display.
+// The stubs pretend that everything succeeds: objects get unique names, shaders compile, programs
+// link and queries are available immediately (with a result of 0).
+
+#include "../opengl/glad/include/glad/glad.h"
+
+namespace {
+template <typename R, typename... Args>
+R APIENTRY noop(Args...)
+{
+    return R();
+}
+
+// Only used to deduce the signature from a function pointer type
+template <typename R, typename... Args>
+constexpr auto make_noop(R(APIENTRYP)(Args...))
+{
+    return &noop<R, Args...>;
+}
+
+// All GL calls happen on a single thread (the render thread, if enabled)
+GLuint next_name = 1;
+
+void APIENTRY gen_names(GLsizei n, GLuint* names)
+{
+    for (GLsizei i = 0; i < n; ++i) {
+        names[i] = next_name++;
+    }
+}
+
+GLuint APIENTRY create_shader(GLenum)
+{
+    return next_name++;
+}
+
+GLuint APIENTRY create_program()
+{
+    return next_name++;
+}
+
+GLenum APIENTRY check_framebuffer_status(GLenum)
+{
+    return GL_FRAMEBUFFER_COMPLETE;
+}
+
+void APIENTRY get_shader_or_program_iv(GLuint, GLenum pname, GLint* params)
+{
+    *params = pname == GL_COMPILE_STATUS || pname == GL_LINK_STATUS ? GL_TRUE : 0;
+}
+
+// Limits as a minimal OpenGL 3.3 implementation would report them
+void APIENTRY get_integer_v(GLenum pname, GLint* data)
+{
+    switch (pname) {
+    case GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT:
+        *data = 256;
+        break;
+    case GL_MAX_UNIFORM_BUFFER_BINDINGS:
+        *data = 36;
+        break;
+    case GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS:
+        *data = 48;
+        break;
+    case GL_MAX_VERTEX_ATTRIBS:
+        *data = 16;
+        break;
+    default:
+        *data = 0;
+        break;
+    }
+}
+
+void APIENTRY get_query_object_uiv(GLuint, GLenum pname, GLuint* params)
+{
+    *params = pname == GL_QUERY_RESULT_AVAILABLE ? GL_TRUE : 0;
+}
+
+void APIENTRY get_query_object_ui64v(GLuint, GLenum, GLuint64* params)
+{
+    *params = 0;
+}
+}
+
+#define NULL_GL_NOOP(name) decltype(glad_gl##name) glad_gl##name \
+    = make_noop(decltype(glad_gl##name) {});
+#define NULL_GL(name, func) decltype(glad_gl##name) glad_gl##name = func;
+
+struct gladGLversionStruct GLVersion = { 3, 3 };
+
+int gladLoadGL()
+{
+    return 1;
+}
+
+NULL_GL(GenBuffers, gen_names)
+NULL_GL(GenFramebuffers, gen_names)
+NULL_GL(GenQueries, gen_names)
+NULL_GL(GenRenderbuffers, gen_names)
+NULL_GL(GenTextures, gen_names)
+NULL_GL(GenVertexArrays, gen_names)
+NULL_GL(CheckFramebufferStatus, check_framebuffer_status)
+NULL_GL(CreateShader, create_shader)
+NULL_GL(CreateProgram, create_program)
+NULL_GL(GetShaderiv, get_shader_or_program_iv)
+NULL_GL(GetProgramiv, get_shader_or_program_iv)
+NULL_GL(GetIntegerv, get_integer_v)
+NULL_GL(GetQueryObjectuiv, get_query_object_uiv)
+NULL_GL(GetQueryObjectui64v, get_query_object_ui64v)
+
+NULL_GL_NOOP(ActiveTexture)
+NULL_GL_NOOP(AttachShader)
+NULL_GL_NOOP(BeginQuery)
+NULL_GL_NOOP(BindBuffer)
+NULL_GL_NOOP(BindFramebuffer)
+NULL_GL_NOOP(BindRenderbuffer)
+NULL_GL_NOOP(BindTexture)
+NULL_GL_NOOP(BindVertexArray)
+NULL_GL_NOOP(BlitFramebuffer)
+NULL_GL_NOOP(BufferData)
+NULL_GL_NOOP(BufferSubData)
+NULL_GL_NOOP(ClearBufferfv)
+NULL_GL_NOOP(ClearBufferiv)
+NULL_GL_NOOP(ColorMask)
+NULL_GL_NOOP(CompileShader)
+NULL_GL_NOOP(DeleteBuffers)
+NULL_GL_NOOP(DeleteFramebuffers)
+NULL_GL_NOOP(DeleteProgram)
+NULL_GL_NOOP(DeleteQueries)
+NULL_GL_NOOP(DeleteRenderbuffers)
+NULL_GL_NOOP(DeleteShader)
+NULL_GL_NOOP(DeleteTextures)
+NULL_GL_NOOP(DeleteVertexArrays)
+NULL_GL_NOOP(Disable)
+NULL_GL_NOOP(DrawArrays)
+NULL_GL_NOOP(DrawArraysInstanced)
+NULL_GL_NOOP(DrawElements)
+NULL_GL_NOOP(DrawElementsInstanced)
+NULL_GL_NOOP(Enable)
+NULL_GL_NOOP(EnableVertexAttribArray)
+NULL_GL_NOOP(EndQuery)
+NULL_GL_NOOP(FramebufferRenderbuffer)
+NULL_GL_NOOP(FramebufferTexture2D)
+NULL_GL_NOOP(GenerateMipmap)
+NULL_GL_NOOP(GetError)
+NULL_GL_NOOP(GetProgramInfoLog)
+NULL_GL_NOOP(GetShaderInfoLog)
+NULL_GL_NOOP(GetString)
+NULL_GL_NOOP(GetStringi)
+NULL_GL_NOOP(GetUniformLocation)
+NULL_GL_NOOP(LinkProgram)
+NULL_GL_NOOP(ObjectLabel)
+NULL_GL_NOOP(PopDebugGroup)
+NULL_GL_NOOP(PushDebugGroup)
+NULL_GL_NOOP(QueryCounter)
+NULL_GL_NOOP(RenderbufferStorage)
+NULL_GL_NOOP(ShaderSource)
+NULL_GL_NOOP(StencilFunc)
+NULL_GL_NOOP(StencilOp)
+NULL_GL_NOOP(TexImage2D)
+NULL_GL_NOOP(TexParameteri)
+NULL_GL_NOOP(TexSubImage2D)
+NULL_GL_NOOP(Uniform1fv)
+NULL_GL_NOOP(Uniform1i)
+NULL_GL_NOOP(Uniform1uiv)
+NULL_GL_NOOP(Uniform2fv)
+NULL_GL_NOOP(Uniform2iv)
+NULL_GL_NOOP(Uniform2uiv)
+NULL_GL_NOOP(Uniform3fv)
+NULL_GL_NOOP(Uniform3iv)
+NULL_GL_NOOP(Uniform3uiv)
+NULL_GL_NOOP(Uniform4fv)
+NULL_GL_NOOP(Uniform4iv)
+NULL_GL_NOOP(Uniform4uiv)
+NULL_GL_NOOP(UniformMatrix2fv)
+NULL_GL_NOOP(UniformMatrix2x3fv)
+NULL_GL_NOOP(UniformMatrix2x4fv)
+NULL_GL_NOOP(UniformMatrix3fv)
+NULL_GL_NOOP(UniformMatrix3x2fv)
+NULL_GL_NOOP(UniformMatrix3x4fv)
+NULL_GL_NOOP(UniformMatrix4fv)
+NULL_GL_NOOP(UniformMatrix4x2fv)
+NULL_GL_NOOP(UniformMatrix4x3fv)
+NULL_GL_NOOP(UseProgram)
+NULL_GL_NOOP(VertexAttribPointer)
+NULL_GL_NOOP(Viewport)
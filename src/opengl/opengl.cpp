@@ -1,12 +1,18 @@
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <memory>
+#include <mutex>
 #include <optional>
 
 // VSCode doesn't find it at <glad/glad.h>
 #include "glad/include/glad/glad.h"
 
+#include "../capture.hpp"
+#include "../render_thread.hpp"
 #include "../shared.hpp"
+#include "../trace.hpp"
 
 namespace {
 const char* gl_error_string(GLenum error)
@@ -33,6 +39,13 @@ const char* gl_error_string(GLenum error)
     }
 }
 
+// glGetError may synchronize with the driver, so it is traced separately
+GLenum get_gl_error()
+{
+    TRACE_FUNCTION();
+    return glGetError();
+}
+
 std::optional<GLenum> gl_shader_type(mugfx_shader_stage stage)
 {
     switch (stage) {
@@ -71,6 +84,41 @@ std::optional<GLenum> gl_pixel_format(mugfx_pixel_format format)
     }
 }
 
+// Drivers may pad three-component formats to four components
+size_t get_pixel_size(mugfx_pixel_format format)
+{
+    switch (format) {
+    case MUGFX_PIXEL_FORMAT_RGB8:
+        return 3;
+    case MUGFX_PIXEL_FORMAT_RGBA8:
+    case MUGFX_PIXEL_FORMAT_DEPTH24: // padded to 32 bits
+    case MUGFX_PIXEL_FORMAT_DEPTH32F:
+    case MUGFX_PIXEL_FORMAT_DEPTH24_STENCIL8:
+        return 4;
+    case MUGFX_PIXEL_FORMAT_RGB16F:
+        return 6;
+    case MUGFX_PIXEL_FORMAT_RGBA16F:
+        return 8;
+    case MUGFX_PIXEL_FORMAT_RGB32F:
+        return 12;
+    case MUGFX_PIXEL_FORMAT_RGBA32F:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+size_t get_texture_size(mugfx_pixel_format format, size_t width, size_t height, bool mipmaps)
+{
+    size_t size = get_pixel_size(format) * width * height;
+    while (mipmaps && (width > 1 || height > 1)) {
+        width = std::max(width / 2, size_t { 1 });
+        height = std::max(height / 2, size_t { 1 });
+        size += get_pixel_size(format) * width * height;
+    }
+    return size;
+}
+
 struct DataFormat {
     GLenum format;
     GLenum data_type;
@@ -148,23 +196,99 @@ std::optional<GLenum> gl_mag_filter(mugfx_texture_mag_filter filter)
     }
 }
 
-bool bind_texture(uint32_t unit, GLenum target, GLuint texture)
+// Counts the state changes that actually happen
+mugfx_state_change_counts& state_changes()
+{
+    static mugfx_state_change_counts counts = {};
+    return counts;
+}
+
+// Incremented whenever the texture bound to any unit changes
+uint64_t& texture_bind_serial()
+{
+    static uint64_t serial = 0;
+    return serial;
+}
+
+// Functions and constants beyond OpenGL 3.3, which is all that glad loads
+using GlBindTextureUnit = void(APIENTRYP)(GLuint unit, GLuint texture);
+using GlBindTextures = void(APIENTRYP)(GLuint first, GLsizei count, const GLuint* textures);
+using GlBufferStorage
+    = void(APIENTRYP)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+using GlMaxShaderCompilerThreads = void(APIENTRYP)(GLuint count);
+constexpr GLbitfield GL_DYNAMIC_STORAGE_BIT = 0x0100;
+
+// Probed in load_gl. Only written on the render thread (if enabled), but mugfx_get_capabilities
+// copies them on the game thread.
+struct Capabilities {
+    std::mutex mutex;
+    mugfx_capabilities caps = {};
+    // The functions of the selected paths
+    GlBindTextureUnit bind_texture_unit = nullptr;
+    GlBindTextures bind_textures = nullptr;
+    GlBufferStorage buffer_storage = nullptr;
+};
+
+Capabilities& get_capabilities()
 {
+    static Capabilities capabilities;
+    return capabilities;
+}
+
+// The objects that are currently bound, so binding them again can be skipped
+struct BindCache {
     // TODO: Save this per target!
-    static std::array<GLuint, 64> current_texture_2d = {};
+    std::array<GLuint, 64> textures_2d = {};
+    std::array<GLuint, 3> buffers = {};
+    GLuint program = 0;
+    GLuint vao = 0;
+    const void* material = nullptr; // only used to count state changes
+};
+
+BindCache& get_bind_cache()
+{
+    static BindCache cache;
+    return cache;
+}
+
+bool bind_texture(uint32_t unit, GLenum target, GLuint texture)
+{
+    TRACE_FUNCTION();
+    auto& current_texture_2d = get_bind_cache().textures_2d;
     if (target == GL_TEXTURE_2D) {
-        if (unit >= current_texture_2d.size()) {
-            log_error("Texture unit must be in [0, %lu]", current_texture_2d.size());
+        const auto& capabilities = get_capabilities();
+        const auto max_units
+            = std::min(current_texture_2d.size(), capabilities.caps.max_texture_units);
+        if (unit >= max_units) {
+            log_error("Texture unit must be less than %zu", max_units);
             return false;
         }
         if (texture != current_texture_2d[unit]) {
-            glActiveTexture(GL_TEXTURE0 + unit);
-            glBindTexture(target, texture);
-            if (const auto error = glGetError()) {
+            COUNT_STAT(texture_binds, 1);
+            COUNT_STAT(bind_cache_misses, 1);
+            // Neither of the faster paths change the active texture unit, so it stays 0 (see
+            // bind_new_texture).
+            switch (capabilities.caps.texture_bind_path) {
+            case MUGFX_TEXTURE_BIND_PATH_DSA:
+                capabilities.bind_texture_unit(unit, texture);
+                break;
+            case MUGFX_TEXTURE_BIND_PATH_MULTI_BIND:
+                capabilities.bind_textures(unit, 1, &texture);
+                break;
+            default:
+                glActiveTexture(GL_TEXTURE0 + unit);
+                glBindTexture(target, texture);
+                break;
+            }
+            if (const auto error = get_gl_error()) {
                 log_error("Error binding texture %d: %s", texture, gl_error_string(error));
                 return false;
             }
             current_texture_2d[unit] = texture;
+            ++texture_bind_serial();
+            ++state_changes().texture;
+        } else {
+            COUNT_STAT(bind_cache_hits, 1);
         }
     } else {
         log_error("Invalid texture target %d", target);
@@ -173,6 +297,27 @@ bool bind_texture(uint32_t unit, GLenum target, GLuint texture)
     return true;
 }
 
+// A name from glGenTextures only becomes a texture object when it is first bound to a target,
+// which glBindTextureUnit and glBindTextures can't do.
+bool bind_new_texture(GLenum target, GLuint texture)
+{
+    if (get_capabilities().caps.texture_bind_path == MUGFX_TEXTURE_BIND_PATH_BIND_TEXTURE) {
+        return bind_texture(0, target, texture);
+    }
+    assert(target == GL_TEXTURE_2D);
+    COUNT_STAT(texture_binds, 1);
+    // The active texture unit is still 0
+    glBindTexture(target, texture);
+    if (const auto error = get_gl_error()) {
+        log_error("Error binding texture %d: %s", texture, gl_error_string(error));
+        return false;
+    }
+    get_bind_cache().textures_2d[0] = texture;
+    ++texture_bind_serial();
+    ++state_changes().texture;
+    return true;
+}
+
 std::optional<GLenum> gl_buffer_target(mugfx_buffer_target target)
 {
     switch (target) {
@@ -217,15 +362,19 @@ size_t get_buffer_target_index(GLenum target)
 
 bool bind_buffer(GLenum target, GLuint buffer)
 {
-    static std::array<GLuint, 3> current_buffers = {};
-    auto& current_buffer = current_buffers.at(get_buffer_target_index(target));
+    TRACE_FUNCTION();
+    auto& current_buffer = get_bind_cache().buffers.at(get_buffer_target_index(target));
     if (current_buffer != buffer) {
+        COUNT_STAT(buffer_binds, 1);
+        COUNT_STAT(bind_cache_misses, 1);
         glBindBuffer(target, buffer);
-        if (const auto error = glGetError()) {
+        if (const auto error = get_gl_error()) {
             log_error("Error in glBindBuffer: %s", gl_error_string(error));
             return false;
         }
         current_buffer = buffer;
+    } else {
+        COUNT_STAT(bind_cache_hits, 1);
     }
     return true;
 }
@@ -363,14 +512,20 @@ std::optional<GLenum> gl_stencil_func(mugfx_stencil_func func)
 
 bool bind_shader(GLuint program)
 {
-    static GLuint current_program = 0;
+    TRACE_FUNCTION();
+    auto& current_program = get_bind_cache().program;
     if (current_program != program) {
+        COUNT_STAT(program_binds, 1);
+        COUNT_STAT(bind_cache_misses, 1);
         glUseProgram(program);
-        if (const auto error = glGetError()) {
+        if (const auto error = get_gl_error()) {
             log_error("Error in glUseProgram: %s", gl_error_string(error));
             return false;
         }
         current_program = program;
+        ++state_changes().program;
+    } else {
+        COUNT_STAT(bind_cache_hits, 1);
     }
     return true;
 }
@@ -493,21 +648,170 @@ std::optional<size_t> get_index_size(GLenum type)
 
 bool bind_vao(GLuint vao)
 {
-    static GLuint current_vao = 0;
+    TRACE_FUNCTION();
+    auto& current_vao = get_bind_cache().vao;
     if (current_vao != vao) {
+        COUNT_STAT(vao_binds, 1);
+        COUNT_STAT(bind_cache_misses, 1);
         glBindVertexArray(vao);
-        if (const auto error = glGetError()) {
+        if (const auto error = get_gl_error()) {
             log_error("Error in glBindVertexArray: %s", gl_error_string(error));
             return false;
         }
         current_vao = vao;
+        ++state_changes().vao;
+    } else {
+        COUNT_STAT(bind_cache_hits, 1);
     }
     return true;
 }
 
+bool& debug_labels_enabled()
+{
+    static bool enabled = false;
+    return enabled;
+}
+
+void label_object(GLenum identifier, GLuint name, const char* label)
+{
+    if (label && debug_labels_enabled()) {
+        glObjectLabel(identifier, name, -1, label);
+    }
+}
+
+bool has_gl_extension(const char* name)
+{
+    GLint num_extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+    for (GLint i = 0; i < num_extensions; ++i) {
+        const auto ext = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (ext && std::strcmp(ext, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename Func>
+void load_gl_function(Func& func, mugfx_get_proc_address get_proc_address, const char* name)
+{
+    if (!func && get_proc_address) {
+        func = reinterpret_cast<Func>(get_proc_address(name));
+    }
+}
+
+size_t get_gl_limit(GLenum name)
+{
+    GLint value = 0;
+    glGetIntegerv(name, &value);
+    return static_cast<size_t>(std::max(value, 0));
+}
+
+void probe_capabilities(mugfx_get_proc_address get_proc_address)
+{
+    mugfx_capabilities caps = {};
+    caps.gl_major = GLVersion.major;
+    caps.gl_minor = GLVersion.minor;
+    const auto version_str = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    caps.gles = version_str && std::strncmp(version_str, "OpenGL ES", 9) == 0;
+
+    const auto version = caps.gl_major * 10 + caps.gl_minor;
+    const auto core = [&](int desktop_version) { return !caps.gles && version >= desktop_version; };
+    caps.direct_state_access = core(45) || has_gl_extension("GL_ARB_direct_state_access");
+    caps.buffer_storage = core(44) || has_gl_extension("GL_ARB_buffer_storage")
+        || has_gl_extension("GL_EXT_buffer_storage");
+    caps.multi_bind = core(44) || has_gl_extension("GL_ARB_multi_bind");
+    caps.multi_draw_indirect = core(43) || has_gl_extension("GL_ARB_multi_draw_indirect")
+        || has_gl_extension("GL_EXT_multi_draw_indirect");
+    caps.parallel_shader_compile = has_gl_extension("GL_KHR_parallel_shader_compile")
+        || has_gl_extension("GL_ARB_parallel_shader_compile");
+    caps.texture_compression_s3tc = has_gl_extension("GL_EXT_texture_compression_s3tc");
+    caps.texture_compression_bptc
+        = core(42) || has_gl_extension("GL_ARB_texture_compression_bptc");
+    caps.texture_compression_etc2 = core(43) || (caps.gles && version >= 30)
+        || has_gl_extension("GL_ARB_ES3_compatibility");
+    caps.texture_compression_astc = has_gl_extension("GL_KHR_texture_compression_astc_ldr");
+    caps.uniform_buffer_offset_alignment = get_gl_limit(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT);
+    caps.max_uniform_buffer_bindings = get_gl_limit(GL_MAX_UNIFORM_BUFFER_BINDINGS);
+    caps.max_texture_units = get_gl_limit(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS);
+    caps.max_vertex_attributes = get_gl_limit(GL_MAX_VERTEX_ATTRIBS);
+
+    GlBindTextureUnit bind_texture_unit = nullptr;
+    GlBindTextures bind_textures = nullptr;
+    GlBufferStorage buffer_storage = nullptr;
+    GlMaxShaderCompilerThreads max_shader_compiler_threads = nullptr;
+    if (caps.direct_state_access) {
+        load_gl_function(bind_texture_unit, get_proc_address, "glBindTextureUnit");
+    }
+    if (caps.multi_bind) {
+        load_gl_function(bind_textures, get_proc_address, "glBindTextures");
+    }
+    if (caps.buffer_storage) {
+        load_gl_function(buffer_storage, get_proc_address, "glBufferStorage");
+        load_gl_function(buffer_storage, get_proc_address, "glBufferStorageEXT");
+    }
+    if (caps.parallel_shader_compile) {
+        load_gl_function(
+            max_shader_compiler_threads, get_proc_address, "glMaxShaderCompilerThreadsKHR");
+        load_gl_function(
+            max_shader_compiler_threads, get_proc_address, "glMaxShaderCompilerThreadsARB");
+    }
+
+    if (bind_texture_unit) {
+        caps.texture_bind_path = MUGFX_TEXTURE_BIND_PATH_DSA;
+    } else if (bind_textures) {
+        caps.texture_bind_path = MUGFX_TEXTURE_BIND_PATH_MULTI_BIND;
+    }
+    if (buffer_storage) {
+        caps.buffer_storage_path = MUGFX_BUFFER_STORAGE_PATH_BUFFER_STORAGE;
+    }
+    if (max_shader_compiler_threads) {
+        // Let the driver use as many threads as it likes
+        max_shader_compiler_threads(0xFFFFFFFF);
+        caps.shader_compiler_threads = true;
+    }
+
+    auto& capabilities = get_capabilities();
+    std::lock_guard lock(capabilities.mutex);
+    capabilities.caps = caps;
+    capabilities.bind_texture_unit = bind_texture_unit;
+    capabilities.bind_textures = bind_textures;
+    capabilities.buffer_storage = buffer_storage;
+}
+
+void reset_capabilities()
+{
+    auto& capabilities = get_capabilities();
+    std::lock_guard lock(capabilities.mutex);
+    capabilities.caps = {};
+    capabilities.bind_texture_unit = nullptr;
+    capabilities.bind_textures = nullptr;
+    capabilities.buffer_storage = nullptr;
+}
+
+void load_gl(bool debug_labels, mugfx_get_proc_address get_proc_address)
+{
+    gladLoadGL(); // Not sure if I need to change something here re ES vs. Core
+    probe_capabilities(get_proc_address);
+
+    if (debug_labels) {
+        // KHR_debug is core since OpenGL 4.3, but glad only loads OpenGL 3.3
+        const auto version = GLVersion.major * 10 + GLVersion.minor;
+        if (version >= 43 || has_gl_extension("GL_KHR_debug")) {
+            load_gl_function(glad_glObjectLabel, get_proc_address, "glObjectLabel");
+            load_gl_function(glad_glPushDebugGroup, get_proc_address, "glPushDebugGroup");
+            load_gl_function(glad_glPopDebugGroup, get_proc_address, "glPopDebugGroup");
+        }
+        debug_labels_enabled() = glObjectLabel && glPushDebugGroup && glPopDebugGroup;
+        if (!debug_labels_enabled()) {
+            log_warn("Debug labels are not supported (is get_proc_address set?)");
+        }
+    }
+}
+
 struct Shader {
     struct Sampler {
-        StackString<> name;
+        Atom name;
         uint32_t binding;
     };
 
@@ -522,12 +826,15 @@ struct Texture {
     GLuint texture;
     size_t width;
     size_t height;
+    size_t gpu_bytes; // estimated
 };
 
 struct Material {
     struct UniformBlock {
         const mugfx_uniform_descriptor* uniform_descriptor;
-        std::array<GLint, MUGFX_MAX_UNIFORMS> locations;
+        const GLint* locations; // one per uniform in the descriptor
+        // The version of the uniform data whose values were last set for this block
+        uint64_t applied_version;
     };
 
     mugfx_shader_id vert_shader;
@@ -544,8 +851,11 @@ struct Material {
     GLenum stencil_func;
     int stencil_ref;
     uint32_t stencil_mask;
-    // `2 *` because of vert and frag
-    std::array<UniformBlock, 2 * MUGFX_MAX_SHADER_UNIFORM_DESCRIPTORS> uniform_blocks;
+    // The blocks of the vert and frag shader, followed by the locations of all blocks. Allocated
+    // with exactly the size that is needed, so the material itself stays small.
+    std::unique_ptr<uint8_t[], Deallocate> uniform_memory;
+    UniformBlock* uniform_blocks;
+    size_t num_uniform_blocks;
 };
 
 struct Buffer {
@@ -554,20 +864,22 @@ struct Buffer {
     size_t size;
 };
 
-struct UniformMetadata {
-    StackString<> name;
-    mugfx_uniform_type type;
-    size_t array_size = 0;
-    size_t offset = 0;
-};
-
 struct UniformData {
     const mugfx_uniform_descriptor* descriptor;
     std::array<UniformMetadata, MUGFX_MAX_UNIFORMS> metadata;
     size_t size = 0;
-    std::unique_ptr<uint8_t> data = {};
+    std::unique_ptr<uint8_t[], Deallocate> data = {};
+    uint64_t version = 0;
 };
 
+// Versions are unique across all uniform data, so a version identifies both the uniform data and
+// its contents.
+uint64_t next_uniform_data_version()
+{
+    static uint64_t version = 0;
+    return ++version;
+}
+
 struct Geometry {
     GLenum draw_mode;
     GLuint vao;
@@ -576,24 +888,270 @@ struct Geometry {
     GLsizei index_count;
 };
 
+struct TextureBinding {
+    uint32_t unit;
+    GLenum target;
+    GLuint texture;
+    uint32_t texture_key;
+};
+
+// Binding sets and draw packets keep pointers (and GL names) of the resources they were created
+// from, together with their keys. The keys are checked before the pointers are used, so resources
+// that were destroyed in the meantime are reported instead of accessed.
+struct BindingSet {
+    size_t num_uniforms;
+    size_t num_textures;
+    std::array<const UniformData*, MUGFX_MAX_DRAW_BINDINGS> uniforms;
+    std::array<uint32_t, MUGFX_MAX_DRAW_BINDINGS> uniform_keys;
+    std::array<TextureBinding, MUGFX_MAX_DRAW_BINDINGS> textures;
+    // The uniform blocks of `uniforms` in the material the set was last used with
+    uint32_t material_key;
+    std::array<Material::UniformBlock*, MUGFX_MAX_DRAW_BINDINGS> blocks;
+    // texture_bind_serial() right after the textures of this set were bound
+    uint64_t texture_serial;
+};
+
+// Everything mugfx_draw needs, resolved from IDs, so it can be submitted without any lookups.
+struct DrawPacket {
+    struct Uniforms {
+        const UniformData* data;
+        Material::UniformBlock* block;
+        uint32_t data_key;
+    };
+
+    Material* material;
+    uint32_t material_key;
+    uint32_t geometry_key;
+    GLuint shader_program;
+    GLuint vao;
+    GLenum draw_mode;
+    GLenum index_type;
+    GLsizei vertex_count;
+    GLsizei index_count;
+    size_t num_binding_sets;
+    size_t num_uniforms;
+    size_t num_textures;
+    std::array<BindingSet*, MUGFX_MAX_DRAW_BINDINGS> binding_sets;
+    std::array<uint32_t, MUGFX_MAX_DRAW_BINDINGS> binding_set_keys;
+    std::array<Uniforms, MUGFX_MAX_DRAW_BINDINGS> uniforms;
+    std::array<TextureBinding, MUGFX_MAX_DRAW_BINDINGS> textures;
+};
+
+struct CommandList {
+    struct Draw {
+        mugfx_material_id material;
+        mugfx_geometry_id geometry;
+        size_t first_binding;
+        size_t num_bindings;
+        size_t instance_count;
+        uint64_t sort_key;
+    };
+
+    Vector<Draw, MUGFX_ALLOCATION_TAG_COMMAND_LIST> draws;
+    Vector<mugfx_draw_binding, MUGFX_ALLOCATION_TAG_COMMAND_LIST> bindings;
+};
+
+// Created in mugfx_init and destroyed in mugfx_shutdown
 template <typename T>
-Pool<T>& get_pool(size_t size = 0)
+std::optional<Pool<T>>& get_pool_storage()
 {
-    static Pool<T> pool(size);
+    static std::optional<Pool<T>> pool;
     return pool;
 }
+
+template <typename T>
+Pool<T>& get_pool()
+{
+    assert(get_pool_storage<T>());
+    return *get_pool_storage<T>();
+}
+
+struct MemoryUsage {
+    size_t gpu_bytes;
+    size_t cpu_bytes;
+};
+
+// Memory owned by an object, outside of its pool
+template <typename T>
+MemoryUsage get_memory_usage(const T&)
+{
+    return { 0, 0 };
+}
+
+MemoryUsage get_memory_usage(const Texture& tex)
+{
+    return { tex.gpu_bytes, 0 };
+}
+
+MemoryUsage get_memory_usage(const Buffer& buf)
+{
+    return { buf.size, 0 };
+}
+
+MemoryUsage get_memory_usage(const UniformData& ud)
+{
+    return { 0, ud.size };
+}
+
+MemoryUsage get_memory_usage(const Material& mat)
+{
+    return { 0, mat.uniform_memory.get_deleter().size };
+}
+
+MemoryUsage get_memory_usage(const CommandList& cl)
+{
+    return { 0,
+        cl.draws.capacity() * sizeof(CommandList::Draw)
+            + cl.bindings.capacity() * sizeof(mugfx_draw_binding) };
+}
+
+// Objects are created and destroyed on the render thread, but read on the game thread
+struct PoolMemory {
+    std::atomic<size_t> gpu_bytes = 0;
+    std::atomic<size_t> cpu_bytes = 0;
+};
+
+template <typename T>
+PoolMemory& get_pool_memory()
+{
+    static PoolMemory memory;
+    return memory;
+}
+
+template <typename T>
+void count_memory(const T& v, bool created)
+{
+    const auto usage = get_memory_usage(v);
+    auto& memory = get_pool_memory<T>();
+    if (created) {
+        memory.gpu_bytes += usage.gpu_bytes;
+        memory.cpu_bytes += usage.cpu_bytes;
+    } else {
+        memory.gpu_bytes -= usage.gpu_bytes;
+        memory.cpu_bytes -= usage.cpu_bytes;
+    }
+}
+
+mugfx_state_change_costs& get_state_change_costs()
+{
+    static mugfx_state_change_costs costs = {};
+    return costs;
+}
+
+// In render thread mode the key for a deferred create call is reserved on the game thread, so it
+// can be returned immediately. The render thread then stores the object under that key.
+uint32_t& reserved_key()
+{
+    thread_local uint32_t key = 0;
+    return key;
+}
+
+// Command lists are created and destroyed on the game thread even in render thread mode, but the
+// frame stats are only counted on the render thread
+void count_resource_stat(bool created)
+{
+#ifdef MUGFX_FRAME_STATS
+    if (render_thread_defers()) {
+        render_thread_defer([=](uint8_t*) { count_resource_stat(created); });
+        return;
+    }
+    if (created) {
+        COUNT_STAT(resources_created, 1);
+    } else {
+        COUNT_STAT(resources_destroyed, 1);
+    }
+#else
+    (void)created;
+#endif
+}
+
+template <typename T>
+uint32_t pool_insert(T&& v)
+{
+    count_resource_stat(true);
+    count_memory(v, true);
+    const auto key = std::exchange(reserved_key(), 0);
+    if (key) {
+        get_pool<T>().emplace(key, std::move(v));
+        return key;
+    }
+    return get_pool<T>().insert(std::move(v));
+}
+
+template <typename T>
+void pool_remove(uint32_t key)
+{
+    count_resource_stat(false);
+    if (const auto v = get_pool<T>().get(key)) {
+        count_memory(*v, false);
+    }
+    get_pool<T>().remove(key);
+}
+
+template <typename T, typename Func>
+uint32_t defer_create(const char* type_name, const DeferredData& data, Func create)
+{
+    const auto key = get_pool<T>().reserve();
+    if (!key) {
+        log_error("Maximum number of %s objects reached", type_name);
+        return 0;
+    }
+    render_thread_defer(data, [key, create](uint8_t* d) mutable {
+        reserved_key() = key;
+        create(d);
+        // If the key is still reserved, creation failed
+        if (std::exchange(reserved_key(), 0)) {
+            get_pool<T>().cancel(key);
+        }
+    });
+    return key;
+}
+
+void init_gpu_profiler(bool pipeline_statistics); // with the rest of the GPU profiler below
+void init_driver_memory(); // with mugfx_get_memory_stats below
 }
 
 EXPORT void mugfx_init(mugfx_init_params params)
 {
+    if (get_pool_storage<Shader>()) {
+        log_error("mugfx is already initialized, call mugfx_shutdown first");
+        return;
+    }
     common_init(params);
-    gladLoadGL(); // Not sure if I need to change something here re ES vs. Core
-    get_pool<Shader>(params.max_num_shaders);
-    get_pool<Texture>(params.max_num_textures);
-    get_pool<Material>(params.max_num_materials);
-    get_pool<Buffer>(params.max_num_buffers);
-    get_pool<UniformData>(params.max_num_uniforms);
-    get_pool<Geometry>(params.max_num_geometries);
+    CAPTURE(CaptureCall::Init, params);
+    get_pool_storage<Shader>().emplace(params.max_num_shaders);
+    get_pool_storage<Texture>().emplace(params.max_num_textures);
+    get_pool_storage<Material>().emplace(params.max_num_materials);
+    get_pool_storage<Buffer>().emplace(params.max_num_buffers);
+    get_pool_storage<UniformData>().emplace(params.max_num_uniforms);
+    get_pool_storage<Geometry>().emplace(params.max_num_geometries);
+    get_pool_storage<DrawPacket>().emplace(params.max_num_draw_packets);
+    get_pool_storage<BindingSet>().emplace(params.max_num_binding_sets);
+    get_pool_storage<CommandList>().emplace(params.max_num_command_lists);
+    get_state_change_costs() = params.state_change_costs;
+
+    const auto debug_labels = params.debug_labels;
+    const auto pipeline_statistics = params.pipeline_statistics;
+    const auto get_proc_address = params.get_proc_address;
+    if (params.render_thread.enabled) {
+        render_thread_start(params.render_thread);
+        render_thread_defer([=](uint8_t*) {
+            load_gl(debug_labels, get_proc_address);
+            init_gpu_profiler(pipeline_statistics);
+            init_driver_memory();
+        });
+    } else {
+        load_gl(debug_labels, get_proc_address);
+        init_gpu_profiler(pipeline_statistics);
+        init_driver_memory();
+    }
+}
+
+EXPORT mugfx_capabilities mugfx_get_capabilities()
+{
+    auto& capabilities = get_capabilities();
+    std::lock_guard lock(capabilities.mutex);
+    return capabilities.caps;
 }
 
 namespace {
@@ -735,6 +1293,7 @@ size_t align(size_t offset, size_t alignment)
 
 void mugfx_uniform_descriptor_calculate_layout(mugfx_uniform_descriptor* uniform_descriptor)
 {
+    TRACE_FUNCTION();
     size_t offset = 0;
     size_t max_alignment = 0;
     for (size_t i = 0; i < MUGFX_MAX_UNIFORMS; ++i) {
@@ -753,6 +1312,26 @@ void mugfx_uniform_descriptor_calculate_layout(mugfx_uniform_descriptor* uniform
 
 EXPORT mugfx_shader_id mugfx_shader_create(mugfx_shader_create_params params)
 {
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::ShaderCreate, params);
+    if (render_thread_defers()) {
+        DeferredData data;
+        const auto source = data.add(params.source);
+        const auto label = data.add(params.label);
+        std::array<size_t, MUGFX_MAX_SHADER_SAMPLERS> sampler_names;
+        for (size_t i = 0; i < MUGFX_MAX_SHADER_SAMPLERS; ++i) {
+            sampler_names[i] = data.add(params.samplers[i].name);
+        }
+        return { defer_create<Shader>("shader", data, [=](uint8_t* d) mutable {
+            params.source = deferred_data<const char>(d, source);
+            params.label = deferred_data<const char>(d, label);
+            for (size_t i = 0; i < MUGFX_MAX_SHADER_SAMPLERS; ++i) {
+                params.samplers[i].name = deferred_data<const char>(d, sampler_names[i]);
+            }
+            mugfx_shader_create(params);
+        }) };
+    }
+
     default_init(params);
 
     const auto shader_type = gl_shader_type(params.stage);
@@ -763,12 +1342,12 @@ EXPORT mugfx_shader_id mugfx_shader_create(mugfx_shader_create_params params)
 
     const GLuint shader = glCreateShader(*shader_type);
     if (shader == 0) {
-        log_error("Failed to create shader object: %s", gl_error_string(glGetError()));
+        log_error("Failed to create shader object: %s", gl_error_string(get_gl_error()));
         return { 0 };
     }
 
     glShaderSource(shader, 1, &params.source, NULL);
-    if (const auto error = glGetError()) {
+    if (const auto error = get_gl_error()) {
         log_error("Error in glShaderSource: %s", gl_error_string(error));
         glDeleteShader(shader);
         return { 0 };
@@ -782,9 +1361,10 @@ EXPORT mugfx_shader_id mugfx_shader_create(mugfx_shader_create_params params)
     GLint log_length = 0;
     glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &log_length);
 
-    std::unique_ptr<char> info_log;
+    std::unique_ptr<char[], Deallocate> info_log;
     if (log_length > 0) {
-        info_log.reset(reinterpret_cast<char*>(allocate(log_length)));
+        info_log.reset(reinterpret_cast<char*>(allocate(log_length, MUGFX_ALLOCATION_TAG_STRING)));
+        info_log.get_deleter() = { static_cast<size_t>(log_length), MUGFX_ALLOCATION_TAG_STRING };
         glGetShaderInfoLog(shader, log_length, NULL, info_log.get());
     }
 
@@ -805,13 +1385,8 @@ EXPORT mugfx_shader_id mugfx_shader_create(mugfx_shader_create_params params)
     };
 
     for (size_t i = 0; i < MUGFX_MAX_SHADER_SAMPLERS; ++i) {
-        const auto name = StackString<>::create(params.samplers[i].name);
-        if (!name) {
-            log_error("Sampler name '%s' too long", params.samplers[i].name);
-            glDeleteShader(shader);
-            return { 0 };
-        }
-        pool_shader.samplers[i].name = *name;
+        const auto name = params.samplers[i].name;
+        pool_shader.samplers[i].name = name ? intern(name) : 0;
         pool_shader.samplers[i].binding = params.samplers[i].binding;
     }
 
@@ -819,28 +1394,49 @@ EXPORT mugfx_shader_id mugfx_shader_create(mugfx_shader_create_params params)
         pool_shader.uniform_descriptors[i] = params.uniform_descriptors[i];
     }
 
-    const auto key = get_pool<Shader>().insert(std::move(pool_shader));
+    label_object(GL_SHADER, shader, params.label);
+    const auto key = pool_insert(std::move(pool_shader));
     return { key };
 }
 
 void mugfx_shader_destroy(mugfx_shader_id shader)
 {
-    const auto tex = get_pool<Shader>().get(shader.id);
-    if (!tex) {
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::ShaderDestroy, shader);
+    if (render_thread_defers()) {
+        render_thread_defer([=](uint8_t*) { mugfx_shader_destroy(shader); });
+        return;
+    }
+
+    const auto sh = get_pool<Shader>().get(shader.id);
+    if (!sh) {
         log_error("Shader ID %u does not exist", shader.id);
         return;
     }
 
-    glDeleteShader(shader.id);
-    if (const auto error = glGetError()) {
+    glDeleteShader(sh->shader);
+    if (const auto error = get_gl_error()) {
         log_error("Failed to delete shader %u: %s", shader.id, gl_error_string(error));
     }
 
-    get_pool<Shader>().remove(shader.id);
+    pool_remove<Shader>(shader.id);
 }
 
 EXPORT mugfx_texture_id mugfx_texture_create(mugfx_texture_create_params params)
 {
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::TextureCreate, params);
+    if (render_thread_defers()) {
+        DeferredData data;
+        const auto offset = data.add(params.data.data, params.data.length);
+        const auto label = data.add(params.label);
+        return { defer_create<Texture>("texture", data, [=](uint8_t* d) mutable {
+            params.data.data = deferred_data<const void>(d, offset);
+            params.label = deferred_data<const char>(d, label);
+            mugfx_texture_create(params);
+        }) };
+    }
+
     default_init(params);
 
     GLuint texture = 0;
@@ -853,7 +1449,7 @@ EXPORT mugfx_texture_id mugfx_texture_create(mugfx_texture_create_params params)
 
     const auto target = GL_TEXTURE_2D;
 
-    if (!bind_texture(0, target, texture)) {
+    if (!bind_new_texture(target, texture)) {
         return error_return();
     }
 
@@ -885,12 +1481,12 @@ EXPORT mugfx_texture_id mugfx_texture_create(mugfx_texture_create_params params)
     }
 
     glTexParameteri(target, GL_TEXTURE_MIN_FILTER, *min_filter);
-    if (const auto error = glGetError()) {
+    if (const auto error = get_gl_error()) {
         log_error("Error setting min filter: %s", gl_error_string(error));
         return error_return();
     }
     glTexParameteri(target, GL_TEXTURE_MAG_FILTER, *mag_filter);
-    if (const auto error = glGetError()) {
+    if (const auto error = get_gl_error()) {
         log_error("Error setting mag filter: %s", gl_error_string(error));
         return error_return();
     }
@@ -910,24 +1506,28 @@ EXPORT mugfx_texture_id mugfx_texture_create(mugfx_texture_create_params params)
 
     glTexImage2D(target, 0, *internal_format, params.width, params.height, 0, data_format->format,
         data_format->data_type, params.data.data);
-    if (const auto error = glGetError()) {
+    COUNT_STAT(texture_upload_bytes, params.data.length);
+    if (const auto error = get_gl_error()) {
         log_error("Error setting mag filter: %s", gl_error_string(error));
         return error_return();
     }
 
     if (params.generate_mipmaps) {
         glGenerateMipmap(target);
-        if (const auto error = glGetError()) {
+        if (const auto error = get_gl_error()) {
             log_error("Error generating mipmaps: %s", gl_error_string(error));
             return error_return();
         }
     }
 
-    const auto key = get_pool<Texture>().insert(Texture {
+    label_object(GL_TEXTURE, texture, params.label);
+    const auto key = pool_insert(Texture {
         .target = target,
         .texture = texture,
         .width = params.width,
         .height = params.height,
+        .gpu_bytes = get_texture_size(
+            params.format, params.width, params.height, params.generate_mipmaps),
     });
     return { key };
 }
@@ -935,6 +1535,18 @@ EXPORT mugfx_texture_id mugfx_texture_create(mugfx_texture_create_params params)
 EXPORT void mugfx_texture_set_data(
     mugfx_texture_id texture, mugfx_slice data, mugfx_pixel_format data_format)
 {
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::TextureSetData, texture, data, data_format);
+    if (render_thread_defers()) {
+        DeferredData copy;
+        const auto offset = copy.add(data.data, data.length);
+        render_thread_defer(copy, [=](uint8_t* d) {
+            mugfx_texture_set_data(
+                texture, { deferred_data<const void>(d, offset), data.length }, data_format);
+        });
+        return;
+    }
+
     const auto tex = get_pool<Texture>().get(texture.id);
     if (!tex) {
         log_error("Texture ID %u does not exist", texture.id);
@@ -953,10 +1565,18 @@ EXPORT void mugfx_texture_set_data(
 
     glTexSubImage2D(
         tex->target, 0, 0, 0, tex->width, tex->height, df->format, df->data_type, data.data);
+    COUNT_STAT(texture_upload_bytes, data.length);
 }
 
 EXPORT void mugfx_texture_destroy(mugfx_texture_id texture)
 {
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::TextureDestroy, texture);
+    if (render_thread_defers()) {
+        render_thread_defer([=](uint8_t*) { mugfx_texture_destroy(texture); });
+        return;
+    }
+
     const auto tex = get_pool<Texture>().get(texture.id);
     if (!tex) {
         log_error("Texture ID %u does not exist", texture.id);
@@ -964,48 +1584,86 @@ EXPORT void mugfx_texture_destroy(mugfx_texture_id texture)
     }
 
     glDeleteTextures(1, &tex->texture);
-    if (const auto error = glGetError()) {
+    if (const auto error = get_gl_error()) {
         log_error("Error destroying texture ID %d: %s", texture.id, gl_error_string(error));
     }
 
-    get_pool<Texture>().remove(texture.id);
+    pool_remove<Texture>(texture.id);
 }
 
 namespace {
-std::optional<size_t> add_uniform_blocks(Material& mat, const Shader& shader, size_t start_index)
+size_t count_uniforms(const mugfx_uniform_descriptor& desc)
 {
-    auto index = start_index;
-    for (size_t i = 0; i < MUGFX_MAX_SHADER_UNIFORM_DESCRIPTORS; ++i) {
-        const auto desc = shader.uniform_descriptors[i];
-        if (!desc) {
-            break;
-        }
-        auto& ub = mat.uniform_blocks[index];
-        ub.uniform_descriptor = desc;
-        ub.locations.fill(-1);
-        for (size_t u = 0; u < MUGFX_MAX_UNIFORMS; ++u) {
-            if (!desc->uniforms[u].type) {
+    size_t count = 0;
+    while (count < MUGFX_MAX_UNIFORMS && desc.uniforms[count].type) {
+        ++count;
+    }
+    return count;
+}
+
+template <typename Func>
+void for_each_uniform_descriptor(const Shader& vert, const Shader& frag, Func&& func)
+{
+    for (const auto shader : { &vert, &frag }) {
+        for (const auto desc : shader->uniform_descriptors) {
+            if (!desc) {
                 break;
             }
-            ub.locations[u] = glGetUniformLocation(mat.shader_program, desc->uniforms[u].name);
-            if (ub.locations[u] == -1) {
+            func(desc);
+        }
+    }
+}
+
+bool init_uniform_blocks(Material& mat, const Shader& vert, const Shader& frag)
+{
+    size_t num_blocks = 0;
+    size_t num_locations = 0;
+    for_each_uniform_descriptor(vert, frag, [&](const mugfx_uniform_descriptor* desc) {
+        num_blocks++;
+        num_locations += count_uniforms(*desc);
+    });
+    if (!num_blocks) {
+        return true;
+    }
+
+    // The blocks first, because they have the stricter alignment
+    static_assert(alignof(Material::UniformBlock) >= alignof(GLint));
+    const auto size = sizeof(Material::UniformBlock) * num_blocks + sizeof(GLint) * num_locations;
+    const auto memory = allocate(size, MUGFX_ALLOCATION_TAG_MATERIAL);
+    mat.uniform_memory = { reinterpret_cast<uint8_t*>(memory),
+        Deallocate { size, MUGFX_ALLOCATION_TAG_MATERIAL } };
+    mat.uniform_blocks = reinterpret_cast<Material::UniformBlock*>(memory);
+    auto locations = reinterpret_cast<GLint*>(mat.uniform_blocks + num_blocks);
+
+    bool success = true;
+    for_each_uniform_descriptor(vert, frag, [&](const mugfx_uniform_descriptor* desc) {
+        const auto num_uniforms = count_uniforms(*desc);
+        for (size_t u = 0; u < num_uniforms && success; ++u) {
+            locations[u] = glGetUniformLocation(mat.shader_program, desc->uniforms[u].name);
+            if (locations[u] == -1) {
                 log_error("Could not get location for uniform '%s'", desc->uniforms[u].name);
-                return std::nullopt;
+                success = false;
             }
         }
-        index++;
-    }
-    return index;
-};
+        mat.uniform_blocks[mat.num_uniform_blocks++] = {
+            .uniform_descriptor = desc,
+            .locations = locations,
+            .applied_version = 0,
+        };
+        locations += num_uniforms;
+    });
+    return success;
+}
 
 bool get_sampler_locations(
     GLuint prog, const Shader& shader, std::array<GLint, MUGFX_MAX_SHADER_SAMPLERS>& locations)
 {
     locations.fill(-1);
-    for (size_t i = 0; i < MUGFX_MAX_SHADER_SAMPLERS && !shader.samplers[i].name.empty(); ++i) {
-        locations[i] = glGetUniformLocation(prog, shader.samplers[i].name.c_str());
+    for (size_t i = 0; i < MUGFX_MAX_SHADER_SAMPLERS && shader.samplers[i].name; ++i) {
+        const auto name = atom_str(shader.samplers[i].name);
+        locations[i] = glGetUniformLocation(prog, name);
         if (locations[i] == -1) {
-            log_error("No uniform with name '%s'", shader.samplers[i].name.c_str());
+            log_error("No uniform with name '%s'", name);
             return false;
         }
     }
@@ -1015,6 +1673,17 @@ bool get_sampler_locations(
 
 EXPORT mugfx_material_id mugfx_material_create(mugfx_material_create_params params)
 {
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::MaterialCreate, params);
+    if (render_thread_defers()) {
+        DeferredData data;
+        const auto label = data.add(params.label);
+        return { defer_create<Material>("material", data, [=](uint8_t* d) mutable {
+            params.label = deferred_data<const char>(d, label);
+            mugfx_material_create(params);
+        }) };
+    }
+
     default_init(params);
 
     const auto depth_func = gl_depth_func(params.depth_func);
@@ -1061,7 +1730,7 @@ EXPORT mugfx_material_id mugfx_material_create(mugfx_material_create_params para
 
     const auto prog = glCreateProgram();
     if (prog == 0) {
-        log_error("Could not create shader program: %s", gl_error_string(glGetError()));
+        log_error("Could not create shader program: %s", gl_error_string(get_gl_error()));
         return { 0 };
     }
 
@@ -1078,14 +1747,14 @@ EXPORT mugfx_material_id mugfx_material_create(mugfx_material_create_params para
     }
 
     glAttachShader(prog, vert->shader);
-    if (const auto error = glGetError()) {
+    if (const auto error = get_gl_error()) {
         log_error("Error in glAttachShader: %s", gl_error_string(error));
         glDeleteProgram(prog);
         return { 0 };
     }
 
     glAttachShader(prog, frag->shader);
-    if (const auto error = glGetError()) {
+    if (const auto error = get_gl_error()) {
         log_error("Error in glAttachShader: %s", gl_error_string(error));
         glDeleteProgram(prog);
         return { 0 };
@@ -1098,9 +1767,10 @@ EXPORT mugfx_material_id mugfx_material_create(mugfx_material_create_params para
     GLint log_length = 0;
     glGetProgramiv(prog, GL_INFO_LOG_LENGTH, &log_length);
 
-    std::unique_ptr<char> info_log;
+    std::unique_ptr<char[], Deallocate> info_log;
     if (log_length > 0) {
-        info_log.reset(reinterpret_cast<char*>(allocate(log_length)));
+        info_log.reset(reinterpret_cast<char*>(allocate(log_length, MUGFX_ALLOCATION_TAG_STRING)));
+        info_log.get_deleter() = { static_cast<size_t>(log_length), MUGFX_ALLOCATION_TAG_STRING };
         glGetProgramInfoLog(prog, log_length, nullptr, info_log.get());
     }
 
@@ -1131,18 +1801,13 @@ EXPORT mugfx_material_id mugfx_material_create(mugfx_material_create_params para
         .stencil_func = *stencil_func,
         .stencil_ref = params.stencil_ref,
         .stencil_mask = params.stencil_mask,
-        .uniform_blocks = {},
+        .uniform_memory = {},
+        .uniform_blocks = nullptr,
+        .num_uniform_blocks = 0,
     };
     std::memcpy(mat.blend_color.data(), params.blend_color, 4 * sizeof(float));
 
-    auto index = add_uniform_blocks(mat, *vert, 0);
-    if (!index) {
-        glDeleteProgram(prog);
-        return { 0 };
-    }
-
-    index = add_uniform_blocks(mat, *frag, *index);
-    if (!index) {
+    if (!init_uniform_blocks(mat, *vert, *frag)) {
         glDeleteProgram(prog);
         return { 0 };
     }
@@ -1160,20 +1825,28 @@ EXPORT mugfx_material_id mugfx_material_create(mugfx_material_create_params para
     }
 
     bind_shader(prog);
-    for (size_t i = 0; i < MUGFX_MAX_SHADER_SAMPLERS && !vert->samplers[i].name.empty(); ++i) {
+    for (size_t i = 0; i < MUGFX_MAX_SHADER_SAMPLERS && vert->samplers[i].name; ++i) {
         glUniform1i(vert_sampler_locations[i], vert->samplers[i].binding);
     }
-    for (size_t i = 0; i < MUGFX_MAX_SHADER_SAMPLERS && !frag->samplers[i].name.empty(); ++i) {
+    for (size_t i = 0; i < MUGFX_MAX_SHADER_SAMPLERS && frag->samplers[i].name; ++i) {
         glUniform1i(frag_sampler_locations[i], frag->samplers[i].binding);
     }
     bind_shader(0);
 
-    const auto key = get_pool<Material>().insert(std::move(mat));
+    label_object(GL_PROGRAM, mat.shader_program, params.label);
+    const auto key = pool_insert(std::move(mat));
     return { key };
 }
 
 EXPORT void mugfx_material_destroy(mugfx_material_id material)
 {
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::MaterialDestroy, material);
+    if (render_thread_defers()) {
+        render_thread_defer([=](uint8_t*) { mugfx_material_destroy(material); });
+        return;
+    }
+
     const auto mat = get_pool<Material>().get(material.id);
     if (!mat) {
         log_error("Material ID %u does not exist", material.id);
@@ -1181,15 +1854,28 @@ EXPORT void mugfx_material_destroy(mugfx_material_id material)
     }
 
     glDeleteProgram(mat->shader_program);
-    if (const auto error = glGetError()) {
+    if (const auto error = get_gl_error()) {
         log_error("Error destroying material ID %d: %s", material.id, gl_error_string(error));
     }
 
-    get_pool<Material>().remove(material.id);
+    pool_remove<Material>(material.id);
 }
 
 EXPORT mugfx_buffer_id mugfx_buffer_create(mugfx_buffer_create_params params)
 {
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::BufferCreate, params);
+    if (render_thread_defers()) {
+        DeferredData data;
+        const auto offset = data.add(params.data.data, params.data.length);
+        const auto label = data.add(params.label);
+        return { defer_create<Buffer>("buffer", data, [=](uint8_t* d) mutable {
+            params.data.data = deferred_data<const void>(d, offset);
+            params.label = deferred_data<const char>(d, label);
+            mugfx_buffer_create(params);
+        }) };
+    }
+
     default_init(params);
 
     if (params.data.length == 0) {
@@ -1214,14 +1900,28 @@ EXPORT mugfx_buffer_id mugfx_buffer_create(mugfx_buffer_create_params params)
 
     // Errors: target is invalid, buffer is not a buffer
     bind_buffer(*target, buffer);
-    glBufferData(*target, params.data.length, params.data.data, *usage);
-    if (const auto error = glGetError()) {
-        log_error("Error in glBufferData: %s", gl_error_string(error));
+    // The size of a buffer never changes, so its storage can be immutable. Immutable storage can't
+    // be empty though.
+    const auto& capabilities = get_capabilities();
+    const auto storage_path = capabilities.caps.buffer_storage_path;
+    const auto immutable
+        = storage_path == MUGFX_BUFFER_STORAGE_PATH_BUFFER_STORAGE && params.data.length > 0;
+    if (immutable) {
+        capabilities.buffer_storage(
+            *target, params.data.length, params.data.data, GL_DYNAMIC_STORAGE_BIT);
+    } else {
+        glBufferData(*target, params.data.length, params.data.data, *usage);
+    }
+    COUNT_STAT(buffer_upload_bytes, params.data.length);
+    if (const auto error = get_gl_error()) {
+        log_error("Error in %s: %s", immutable ? "glBufferStorage" : "glBufferData",
+            gl_error_string(error));
         glDeleteBuffers(1, &buffer);
         return { 0 };
     }
 
-    const auto key = get_pool<Buffer>().insert(Buffer {
+    label_object(GL_BUFFER, buffer, params.label);
+    const auto key = pool_insert(Buffer {
         .target = *target,
         .buffer = buffer,
         .size = params.data.length,
@@ -1232,6 +1932,17 @@ EXPORT mugfx_buffer_id mugfx_buffer_create(mugfx_buffer_create_params params)
 
 EXPORT void mugfx_buffer_set_data(mugfx_buffer_id buffer, mugfx_slice data)
 {
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::BufferSetData, buffer, data);
+    if (render_thread_defers()) {
+        DeferredData copy;
+        const auto offset = copy.add(data.data, data.length);
+        render_thread_defer(copy, [=](uint8_t* d) {
+            mugfx_buffer_set_data(buffer, { deferred_data<const void>(d, offset), data.length });
+        });
+        return;
+    }
+
     const auto buf = get_pool<Buffer>().get(buffer.id);
     if (!buf) {
         log_error("Buffer ID %u does not exist", buffer.id);
@@ -1250,13 +1961,21 @@ EXPORT void mugfx_buffer_set_data(mugfx_buffer_id buffer, mugfx_slice data)
         return;
     }
     glBufferSubData(buf->target, 0, data.length, data.data);
-    if (const auto error = glGetError()) {
+    COUNT_STAT(buffer_upload_bytes, data.length);
+    if (const auto error = get_gl_error()) {
         log_error("Error in glBufferSubData: %s", gl_error_string(error));
     }
 }
 
 EXPORT void mugfx_buffer_destroy(mugfx_buffer_id buffer)
 {
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::BufferDestroy, buffer);
+    if (render_thread_defers()) {
+        render_thread_defer([=](uint8_t*) { mugfx_buffer_destroy(buffer); });
+        return;
+    }
+
     const auto buf = get_pool<Buffer>().get(buffer.id);
     if (!buf) {
         log_error("Buffer ID %u does not exist", buffer.id);
@@ -1264,23 +1983,33 @@ EXPORT void mugfx_buffer_destroy(mugfx_buffer_id buffer)
     }
 
     glDeleteBuffers(1, &buf->buffer);
-    if (const auto error = glGetError()) {
+    if (const auto error = get_gl_error()) {
         log_error("Error destroying buffer ID %d: %s", buffer.id, gl_error_string(error));
     }
 
-    get_pool<Buffer>().remove(buffer.id);
+    pool_remove<Buffer>(buffer.id);
 }
 
 mugfx_uniform_data_id mugfx_uniform_data_create(mugfx_uniform_data_create_params params)
 {
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::UniformDataCreate, params);
+    if (render_thread_defers()) {
+        return { defer_create<UniformData>(
+            "uniform data", {}, [=](uint8_t*) { mugfx_uniform_data_create(params); }) };
+    }
+
     mugfx_uniform_descriptor desc = *params.descriptor;
     mugfx_uniform_descriptor_calculate_layout(&desc);
 
+    const auto data = allocate(desc.size, MUGFX_ALLOCATION_TAG_UNIFORM_DATA);
     UniformData ub {
         .descriptor = params.descriptor,
         .metadata = {},
         .size = desc.size,
-        .data = std::unique_ptr<uint8_t>(reinterpret_cast<uint8_t*>(allocate(desc.size))),
+        .data = { reinterpret_cast<uint8_t*>(data),
+            Deallocate { desc.size, MUGFX_ALLOCATION_TAG_UNIFORM_DATA } },
+        .version = next_uniform_data_version(),
     };
     std::memset(ub.data.get(), 0, desc.size);
 
@@ -1291,33 +2020,19 @@ mugfx_uniform_data_id mugfx_uniform_data_create(mugfx_uniform_data_create_params
         }
 
         if (u.name) {
-            const auto name = StackString<>::create(u.name);
-            if (!name) {
-                log_error("Invalid uniform name '%s'", u.name);
-                return { 0 };
-            }
-            ub.metadata[i].name = *name;
+            ub.metadata[i].name = intern(u.name);
+            ub.metadata[i].name_hash = hash_string(u.name);
         }
         ub.metadata[i].type = u.type;
         ub.metadata[i].array_size = u.array_size;
         ub.metadata[i].offset = u.offset;
     }
 
-    const auto key = get_pool<UniformData>().insert(std::move(ub));
+    const auto key = pool_insert(std::move(ub));
     return { key };
 }
 
 namespace {
-size_t get_uniform_index(UniformData& ub, const char* name)
-{
-    for (size_t i = 0; i < MUGFX_MAX_UNIFORMS; ++i) {
-        if (ub.metadata[i].type && ub.metadata[i].name == name) {
-            return i;
-        }
-    }
-    return MUGFX_MAX_UNIFORMS;
-}
-
 size_t get_float_uniform_data_size(mugfx_uniform_type type)
 {
     switch (type) {
@@ -1406,13 +2121,26 @@ const char* get_uniform_type_name(mugfx_uniform_type type)
 void mugfx_uniform_data_set_float(
     mugfx_uniform_data_id uniform_data, const char* name, mugfx_slice data)
 {
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::UniformDataSetFloat, uniform_data, name, data);
+    if (render_thread_defers()) {
+        DeferredData copy;
+        const auto name_offset = copy.add(name);
+        const auto data_offset = copy.add(data.data, data.length);
+        render_thread_defer(copy, [=](uint8_t* d) {
+            mugfx_uniform_data_set_float(uniform_data, deferred_data<const char>(d, name_offset),
+                { deferred_data<const void>(d, data_offset), data.length });
+        });
+        return;
+    }
+
     const auto ub = get_pool<UniformData>().get(uniform_data.id);
     if (!ub) {
         log_error("Uniform Data ID %u does not exist", uniform_data.id);
         return;
     }
 
-    const auto idx = get_uniform_index(*ub, name);
+    const auto idx = get_uniform_index(ub->metadata, name);
     if (idx >= MUGFX_MAX_UNIFORMS) {
         log_error("Unknown uniform name '%s'", name);
         return;
@@ -1433,18 +2161,31 @@ void mugfx_uniform_data_set_float(
     // TODO: For e.g. mat2 transform the passed data into a format for the uniform buffer (as soon
     // as I start using them)
     std::memcpy(ub->data.get(), data.data, data.length);
+    ub->version = next_uniform_data_version();
 }
 
 void mugfx_uniform_data_set_texture(
     mugfx_uniform_data_id uniform_data, const char* name, mugfx_texture_id texture)
 {
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::UniformDataSetTexture, uniform_data, name, texture);
+    if (render_thread_defers()) {
+        DeferredData copy;
+        const auto name_offset = copy.add(name);
+        render_thread_defer(copy, [=](uint8_t* d) {
+            mugfx_uniform_data_set_texture(
+                uniform_data, deferred_data<const char>(d, name_offset), texture);
+        });
+        return;
+    }
+
     const auto ub = get_pool<UniformData>().get(uniform_data.id);
     if (!ub) {
         log_error("Uniform Data ID %u does not exist", uniform_data.id);
         return;
     }
 
-    const auto idx = get_uniform_index(*ub, name);
+    const auto idx = get_uniform_index(ub->metadata, name);
     if (idx >= MUGFX_MAX_UNIFORMS) {
         log_error("Unknown uniform name '%s'", name);
         return;
@@ -1457,20 +2198,39 @@ void mugfx_uniform_data_set_texture(
         return;
     }
     std::memcpy(ub->data.get(), &texture.id, sizeof(uint32_t));
+    ub->version = next_uniform_data_version();
 }
 
 void mugfx_uniform_data_destroy(mugfx_uniform_data_id uniform_data)
 {
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::UniformDataDestroy, uniform_data);
+    if (render_thread_defers()) {
+        render_thread_defer([=](uint8_t*) { mugfx_uniform_data_destroy(uniform_data); });
+        return;
+    }
+
     const auto buf = get_pool<UniformData>().get(uniform_data.id);
     if (!buf) {
         log_error("Uniform data ID %u does not exist", uniform_data.id);
         return;
     }
-    get_pool<UniformData>().remove(uniform_data.id);
+    pool_remove<UniformData>(uniform_data.id);
 }
 
 EXPORT mugfx_geometry_id mugfx_geometry_create(mugfx_geometry_create_params params)
 {
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::GeometryCreate, params);
+    if (render_thread_defers()) {
+        DeferredData data;
+        const auto label = data.add(params.label);
+        return { defer_create<Geometry>("geometry", data, [=](uint8_t* d) mutable {
+            params.label = deferred_data<const char>(d, label);
+            mugfx_geometry_create(params);
+        }) };
+    }
+
     default_init(params);
 
     const auto draw_mode = gl_draw_mode(params.draw_mode);
@@ -1614,7 +2374,7 @@ EXPORT mugfx_geometry_id mugfx_geometry_create(mugfx_geometry_create_params para
 
             const auto& attr = vfmt[b].attrs[a];
             glEnableVertexAttribArray(attr.location);
-            if (const auto error = glGetError()) {
+            if (const auto error = get_gl_error()) {
                 log_error("Error in glEnableVertexAttribArray: %s", gl_error_string(error));
                 glDeleteVertexArrays(1, &geom.vao);
                 return { 0 };
@@ -1623,7 +2383,7 @@ EXPORT mugfx_geometry_id mugfx_geometry_create(mugfx_geometry_create_params para
                 = reinterpret_cast<const GLvoid*>(vfmt[b].buffer_offset + attr.offset);
             glVertexAttribPointer(
                 attr.location, attr.components, attr.type, attr.normalized, vfmt[b].stride, offset);
-            if (const auto error = glGetError()) {
+            if (const auto error = get_gl_error()) {
                 log_error("Error in glVertexAttribPointer(%d, %d, %d, %d, %d, %p): %s",
                     attr.location, attr.components, attr.type, attr.normalized, vfmt[b].stride,
                     offset, gl_error_string(error));
@@ -1643,12 +2403,20 @@ EXPORT mugfx_geometry_id mugfx_geometry_create(mugfx_geometry_create_params para
 
     glBindVertexArray(0);
 
-    const auto key = get_pool<Geometry>().insert(std::move(geom));
+    label_object(GL_VERTEX_ARRAY, geom.vao, params.label);
+    const auto key = pool_insert(std::move(geom));
     return { key };
 }
 
 EXPORT void mugfx_geometry_destroy(mugfx_geometry_id geometry)
 {
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::GeometryDestroy, geometry);
+    if (render_thread_defers()) {
+        render_thread_defer([=](uint8_t*) { mugfx_geometry_destroy(geometry); });
+        return;
+    }
+
     const auto geom = get_pool<Geometry>().get(geometry.id);
     if (!geom) {
         log_error("Geometry ID %u does not exist", geometry.id);
@@ -1656,11 +2424,11 @@ EXPORT void mugfx_geometry_destroy(mugfx_geometry_id geometry)
     }
 
     glDeleteVertexArrays(1, &geom->vao);
-    if (const auto error = glGetError()) {
+    if (const auto error = get_gl_error()) {
         log_error("Error in glDeleteVertexArrays: %s", gl_error_string(error));
     }
 
-    get_pool<Geometry>().remove(geometry.id);
+    pool_remove<Geometry>(geometry.id);
 }
 
 EXPORT mugfx_render_target_id mugfx_render_target_create(mugfx_render_target_create_params params)
@@ -1682,9 +2450,32 @@ EXPORT void mugfx_render_target_destroy(mugfx_render_target_id target) { }
 
 EXPORT void mugfx_render_target_bind(mugfx_render_target_id target) { }
 
+namespace {
+struct Viewport {
+    int x = 0;
+    int y = 0;
+    size_t width = 0;
+    size_t height = 0;
+};
+
+Viewport& current_viewport()
+{
+    static Viewport viewport;
+    return viewport;
+}
+}
+
 EXPORT void mugfx_set_viewport(int x, int y, size_t width, size_t height)
 {
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::SetViewport, x, y, width, height);
+    if (render_thread_defers()) {
+        render_thread_defer([=](uint8_t*) { mugfx_set_viewport(x, y, width, height); });
+        return;
+    }
+
     glViewport(x, y, static_cast<GLsizei>(width), static_cast<GLsizei>(height));
+    current_viewport() = { x, y, width, height };
 }
 
 EXPORT void mugfx_set_scissor(int x, int y, size_t width, size_t height) { }
@@ -1692,10 +2483,13 @@ EXPORT void mugfx_set_scissor(int x, int y, size_t width, size_t height) { }
 namespace {
 bool set_uniform(const UniformMetadata& uniform, GLint loc, const uint8_t* data)
 {
+    TRACE_FUNCTION();
     const auto count = uniform.array_size ? static_cast<GLsizei>(uniform.array_size) : 1;
     const auto fdata = reinterpret_cast<const GLfloat*>(data + uniform.offset);
     const auto idata = reinterpret_cast<const GLint*>(data + uniform.offset);
     const auto udata = reinterpret_cast<const GLuint*>(data + uniform.offset);
+    COUNT_STAT(uniform_calls, 1);
+    COUNT_STAT(uniform_bytes, get_uniform_size(uniform.type, uniform.array_size));
     switch (uniform.type) {
     case MUGFX_UNIFORM_TYPE_FLOAT:
         glUniform1fv(loc, count, fdata);
@@ -1764,105 +2558,2067 @@ bool set_uniform(const UniformMetadata& uniform, GLint loc, const uint8_t* data)
         log_error("Invalid uniform type %d", uniform.type);
         return false;
     }
-    if (const auto error = glGetError()) {
+    if (const auto error = get_gl_error()) {
         log_error("Error in glUniform: %s", gl_error_string(error));
         return false;
     }
     return true;
 }
 
-const Material::UniformBlock* find_uniform_block(
-    const Material& mat, const mugfx_uniform_descriptor* desc)
+Material::UniformBlock* find_uniform_block(Material& mat, const mugfx_uniform_descriptor* desc)
 {
-    for (const auto& ub : mat.uniform_blocks) {
-        if (ub.uniform_descriptor == desc) {
-            return &ub;
+    for (size_t i = 0; i < mat.num_uniform_blocks; ++i) {
+        if (mat.uniform_blocks[i].uniform_descriptor == desc) {
+            return &mat.uniform_blocks[i];
         }
     }
     return nullptr;
 }
 
-bool apply_uniforms(const Material& mat, mugfx_uniform_data_id uniform_data)
+bool apply_uniforms(const UniformData& ud, Material::UniformBlock& ub)
 {
-    const auto ud = get_pool<UniformData>().get(uniform_data.id);
-    if (!ud) {
-        log_error("Uniform data ID %u does not exist", uniform_data.id);
-        return false;
+    TRACE_FUNCTION();
+    // The values are still set in the program
+    if (ub.applied_version == ud.version) {
+        return true;
     }
 
+    ub.applied_version = 0;
     for (size_t i = 0; i < MUGFX_MAX_UNIFORMS; ++i) {
-        if (!ud->metadata[i].type) {
+        if (!ud.metadata[i].type) {
             break;
         }
-        const auto ub = find_uniform_block(mat, ud->descriptor);
-        if (!ub) {
-            log_error("No uniform block with descriptor in material");
+        // TODO: Use a span here for safety
+        if (!set_uniform(ud.metadata[i], ub.locations[i], ud.data.get())) {
             return false;
         }
-        // TODO: Use a span here for safety
-        if (!set_uniform(ud->metadata[i], ub->locations[i], ud->data.get())) {
+    }
+    ub.applied_version = ud.version;
+    ++state_changes().uniforms;
+    return true;
+}
+
+std::optional<TextureBinding> resolve_texture_binding(const mugfx_draw_binding& binding)
+{
+    const auto tex = get_pool<Texture>().get(binding.texture.id.id);
+    if (!tex) {
+        log_error("Texture ID %u does not exist", binding.texture.id.id);
+        return std::nullopt;
+    }
+    return TextureBinding { binding.texture.binding, tex->target, tex->texture,
+        binding.texture.id.id };
+}
+
+bool validate_binding_set(const BindingSet& set)
+{
+    for (size_t i = 0; i < set.num_uniforms; ++i) {
+        if (!get_pool<UniformData>().contains(set.uniform_keys[i])) {
+            log_error("Uniform data ID %u of binding set was destroyed", set.uniform_keys[i]);
             return false;
         }
     }
+    for (size_t i = 0; i < set.num_textures; ++i) {
+        if (!get_pool<Texture>().contains(set.textures[i].texture_key)) {
+            log_error("Texture ID %u of binding set was destroyed", set.textures[i].texture_key);
+            return false;
+        }
+    }
+    return true;
+}
 
+// Only needed for draw packets that were created earlier, the others were just resolved
+bool validate_draw_packet(const DrawPacket& packet)
+{
+    if (!get_pool<Material>().contains(packet.material_key)) {
+        log_error("Material ID %u of draw packet was destroyed", packet.material_key);
+        return false;
+    }
+    if (!get_pool<Geometry>().contains(packet.geometry_key)) {
+        log_error("Geometry ID %u of draw packet was destroyed", packet.geometry_key);
+        return false;
+    }
+    for (size_t i = 0; i < packet.num_binding_sets; ++i) {
+        if (!get_pool<BindingSet>().contains(packet.binding_set_keys[i])) {
+            log_error("Binding set ID %u of draw packet was destroyed", packet.binding_set_keys[i]);
+            return false;
+        }
+        if (!validate_binding_set(*packet.binding_sets[i])) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < packet.num_uniforms; ++i) {
+        if (!get_pool<UniformData>().contains(packet.uniforms[i].data_key)) {
+            log_error(
+                "Uniform data ID %u of draw packet was destroyed", packet.uniforms[i].data_key);
+            return false;
+        }
+    }
+    for (size_t i = 0; i < packet.num_textures; ++i) {
+        if (!get_pool<Texture>().contains(packet.textures[i].texture_key)) {
+            log_error("Texture ID %u of draw packet was destroyed", packet.textures[i].texture_key);
+            return false;
+        }
+    }
     return true;
 }
+
+bool resolve_uniform_blocks(BindingSet& set, Material& mat, uint32_t material_key)
+{
+    if (set.material_key == material_key) {
+        return true;
+    }
+    for (size_t i = 0; i < set.num_uniforms; ++i) {
+        set.blocks[i] = find_uniform_block(mat, set.uniforms[i]->descriptor);
+        if (!set.blocks[i]) {
+            log_error("No uniform block with descriptor in material");
+            set.material_key = 0;
+            return false;
+        }
+    }
+    set.material_key = material_key;
+    return true;
 }
 
-EXPORT void mugfx_begin_frame() { }
+bool apply_binding_set(BindingSet& set, Material& mat, uint32_t material_key)
+{
+    if (!resolve_uniform_blocks(set, mat, material_key)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < set.num_uniforms; ++i) {
+        if (!apply_uniforms(*set.uniforms[i], *set.blocks[i])) {
+            return false;
+        }
+    }
 
-void mugfx_draw(mugfx_material_id material, mugfx_geometry_id geometry,
-    mugfx_draw_binding* bindings, size_t num_bindings)
+    // If no texture binding changed since we bound the textures of this set, they are all still
+    // bound.
+    if (set.texture_serial != texture_bind_serial()) {
+        for (size_t i = 0; i < set.num_textures; ++i) {
+            const auto& tex = set.textures[i];
+            if (!bind_texture(tex.unit, tex.target, tex.texture)) {
+                return false;
+            }
+        }
+        set.texture_serial = texture_bind_serial();
+    }
+
+    return true;
+}
+
+bool resolve_draw_packet(DrawPacket& packet, mugfx_material_id material,
+    mugfx_geometry_id geometry, const mugfx_draw_binding* bindings, size_t num_bindings)
 {
     const auto mat = get_pool<Material>().get(material.id);
     if (!mat) {
         log_error("Material ID %u does not exist", material.id);
-        return;
+        return false;
     }
 
     const auto geom = get_pool<Geometry>().get(geometry.id);
     if (!geom) {
         log_error("Geometry ID %u does not exist", geometry.id);
-        return;
+        return false;
     }
 
-    if (!bind_shader(mat->shader_program)) {
-        return;
-    }
+    packet.material = mat;
+    packet.material_key = material.id;
+    packet.geometry_key = geometry.id;
+    packet.shader_program = mat->shader_program;
+    packet.vao = geom->vao;
+    packet.draw_mode = geom->draw_mode;
+    packet.index_type = geom->index_type;
+    packet.vertex_count = geom->vertex_count;
+    packet.index_count = geom->index_count;
+    packet.num_binding_sets = 0;
+    packet.num_uniforms = 0;
+    packet.num_textures = 0;
 
     for (size_t i = 0; i < num_bindings; ++i) {
         if (bindings[i].type == MUGFX_BINDING_TYPE_UNIFORM_DATA) {
-            if (!apply_uniforms(*mat, bindings[i].uniform_data.id)) {
-                return;
+            const auto ud = get_pool<UniformData>().get(bindings[i].uniform_data.id.id);
+            if (!ud) {
+                log_error("Uniform data ID %u does not exist", bindings[i].uniform_data.id.id);
+                return false;
+            }
+            const auto ub = find_uniform_block(*mat, ud->descriptor);
+            if (!ub) {
+                log_error("No uniform block with descriptor in material");
+                return false;
             }
+            if (packet.num_uniforms >= packet.uniforms.size()) {
+                log_error("Number of uniform data bindings exceeds %lu", packet.uniforms.size());
+                return false;
+            }
+            packet.uniforms[packet.num_uniforms++] = { ud, ub, bindings[i].uniform_data.id.id };
         } else if (bindings[i].type == MUGFX_BINDING_TYPE_TEXTURE) {
-            const auto tex = get_pool<Texture>().get(bindings[i].texture.id.id);
+            const auto tex = resolve_texture_binding(bindings[i]);
             if (!tex) {
-                log_error("Texture ID %u does not exist", bindings[i].texture.id.id);
-                return;
+                return false;
+            }
+            if (packet.num_textures >= packet.textures.size()) {
+                log_error("Number of texture bindings exceeds %lu", packet.textures.size());
+                return false;
+            }
+            packet.textures[packet.num_textures++] = *tex;
+        } else if (bindings[i].type == MUGFX_BINDING_TYPE_BINDING_SET) {
+            const auto set = get_pool<BindingSet>().get(bindings[i].binding_set.id.id);
+            if (!set) {
+                log_error("Binding set ID %u does not exist", bindings[i].binding_set.id.id);
+                return false;
+            }
+            if (packet.num_binding_sets >= packet.binding_sets.size()) {
+                log_error("Number of binding sets exceeds %lu", packet.binding_sets.size());
+                return false;
+            }
+            if (!validate_binding_set(*set)) {
+                return false;
             }
-            if (!bind_texture(bindings[i].texture.binding, tex->target, tex->texture)) {
-                return;
+            // Resolve here already, so we report a missing uniform block early
+            if (!resolve_uniform_blocks(*set, *mat, material.id)) {
+                return false;
             }
+            packet.binding_set_keys[packet.num_binding_sets] = bindings[i].binding_set.id.id;
+            packet.binding_sets[packet.num_binding_sets++] = set;
         }
     }
 
-    if (!bind_vao(geom->vao)) {
-        return;
+    return true;
+}
+
+[[maybe_unused]] size_t count_triangles(const DrawPacket& packet)
+{
+    const auto count
+        = static_cast<size_t>(packet.index_type ? packet.index_count : packet.vertex_count);
+    switch (packet.draw_mode) {
+    case GL_TRIANGLES:
+        return count / 3;
+    case GL_TRIANGLE_STRIP:
+    case GL_TRIANGLE_FAN:
+        return count >= 3 ? count - 2 : 0;
+    default:
+        return 0;
+    }
+}
+
+// Does not unbind the VAO afterwards, so consecutive draws can share the binding.
+bool execute_draw_packet(const DrawPacket& packet, size_t instance_count)
+{
+    if (!bind_shader(packet.shader_program)) {
+        return false;
     }
-    if (geom->index_type) {
-        glDrawElements(geom->draw_mode, geom->index_count, geom->index_type, 0);
+
+    auto& current_material = get_bind_cache().material;
+    if (packet.material != current_material) {
+        current_material = packet.material;
+        ++state_changes().state;
+    }
+
+    // Sets first, so that individual bindings may override them
+    for (size_t i = 0; i < packet.num_binding_sets; ++i) {
+        if (!apply_binding_set(*packet.binding_sets[i], *packet.material, packet.material_key)) {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < packet.num_uniforms; ++i) {
+        if (!apply_uniforms(*packet.uniforms[i].data, *packet.uniforms[i].block)) {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < packet.num_textures; ++i) {
+        const auto& tex = packet.textures[i];
+        if (!bind_texture(tex.unit, tex.target, tex.texture)) {
+            return false;
+        }
+    }
+
+    if (!bind_vao(packet.vao)) {
+        return false;
+    }
+    const auto instances = static_cast<GLsizei>(instance_count);
+    COUNT_STAT(draws, 1);
+    COUNT_STAT(instances, instance_count);
+    COUNT_STAT(triangles, count_triangles(packet) * instance_count);
+    if (packet.index_type) {
+        if (instance_count == 1) {
+            glDrawElements(packet.draw_mode, packet.index_count, packet.index_type, 0);
+        } else {
+            glDrawElementsInstanced(
+                packet.draw_mode, packet.index_count, packet.index_type, 0, instances);
+        }
     } else {
-        glDrawArrays(geom->draw_mode, 0, geom->vertex_count);
+        if (instance_count == 1) {
+            glDrawArrays(packet.draw_mode, 0, packet.vertex_count);
+        } else {
+            glDrawArraysInstanced(packet.draw_mode, 0, packet.vertex_count, instances);
+        }
+    }
+    return true;
+}
+
+struct ReorderDraw {
+    DrawPacket packet;
+    size_t instance_count;
+};
+
+// The state of a draw, most expensive kind of state first
+using ReorderKey = std::array<uint32_t, 5>;
+// Number of sorted draws reordered greedily at once. The greedy pass is quadratic in this.
+constexpr size_t ReorderWindowSize = 32;
+
+struct ReorderGroup {
+    bool active = false;
+    Vector<ReorderDraw> draws;
+    Vector<uint32_t> order;
+    Vector<ReorderKey> keys; // scratch space for reorder_draws
+};
+
+ReorderGroup& get_reorder_group()
+{
+    static ReorderGroup group;
+    return group;
+}
+
+struct ReorderStats {
+    mugfx_reorder_stats current = {};
+    std::mutex mutex; // guards last_frame, which is read from the game thread
+    mugfx_reorder_stats last_frame = {};
+};
+
+ReorderStats& get_reorder_stats()
+{
+    static ReorderStats stats;
+    return stats;
+}
+
+// Draws in a reorder group are only buffered
+bool submit_draw_packet(const DrawPacket& packet, size_t instance_count)
+{
+    auto& group = get_reorder_group();
+    if (group.active) {
+        group.draws.push_back({ packet, instance_count });
+        return true;
+    }
+    return execute_draw_packet(packet, instance_count);
+}
+
+template <typename Func>
+void for_each_texture(const DrawPacket& packet, Func func)
+{
+    for (size_t s = 0; s < packet.num_binding_sets; ++s) {
+        const auto& set = *packet.binding_sets[s];
+        for (size_t i = 0; i < set.num_textures; ++i) {
+            func(set.textures[i]);
+        }
+    }
+    for (size_t i = 0; i < packet.num_textures; ++i) {
+        func(packet.textures[i]);
+    }
+}
+
+template <typename Func>
+void for_each_uniform_data(const DrawPacket& packet, Func func)
+{
+    for (size_t s = 0; s < packet.num_binding_sets; ++s) {
+        const auto& set = *packet.binding_sets[s];
+        for (size_t i = 0; i < set.num_uniforms; ++i) {
+            func(set.uniforms[i]);
+        }
+    }
+    for (size_t i = 0; i < packet.num_uniforms; ++i) {
+        func(packet.uniforms[i].data);
+    }
+}
+
+uint32_t pointer_hash(const void* ptr)
+{
+    const auto v = reinterpret_cast<uintptr_t>(ptr);
+    return inthash(static_cast<uint32_t>(v) ^ inthash(static_cast<uint32_t>(v >> 32)));
+}
+
+// Simulates the bind caches to count the state changes of executing the draws in `order`.
+// Uniform uploads are approximated by comparing with the previous draw only.
+mugfx_state_change_counts estimate_state_changes(
+    const Vector<ReorderDraw>& draws, const Vector<uint32_t>& order)
+{
+    mugfx_state_change_counts counts = {};
+    std::array<GLuint, 64> textures;
+    textures.fill(UINT32_MAX);
+    const DrawPacket* prev = nullptr;
+    for (const auto idx : order) {
+        const auto& packet = draws[idx].packet;
+        if (!prev || packet.shader_program != prev->shader_program) {
+            ++counts.program;
+        }
+        if (!prev || packet.vao != prev->vao) {
+            ++counts.vao;
+        }
+        const auto material_changed = !prev || packet.material != prev->material;
+        if (material_changed) {
+            ++counts.state;
+        }
+        for_each_texture(packet, [&](const TextureBinding& tex) {
+            if (tex.unit < textures.size() && textures[tex.unit] != tex.texture) {
+                textures[tex.unit] = tex.texture;
+                ++counts.texture;
+            }
+        });
+        for_each_uniform_data(packet, [&](const UniformData* ud) {
+            bool bound = false;
+            if (!material_changed) {
+                for_each_uniform_data(*prev, [&](const UniformData* p) { bound |= p == ud; });
+            }
+            counts.uniforms += bound ? 0 : 1;
+        });
+        prev = &packet;
+    }
+    return counts;
+}
+
+float estimate_cost(const mugfx_state_change_counts& counts)
+{
+    const auto& costs = get_state_change_costs();
+    return costs.program * counts.program + costs.vao * counts.vao
+        + costs.texture * counts.texture + costs.state * counts.state
+        + costs.uniforms * counts.uniforms;
+}
+
+void add(mugfx_state_change_counts& a, const mugfx_state_change_counts& b)
+{
+    a.program += b.program;
+    a.vao += b.vao;
+    a.texture += b.texture;
+    a.state += b.state;
+    a.uniforms += b.uniforms;
+}
+
+mugfx_state_change_counts diff(
+    const mugfx_state_change_counts& a, const mugfx_state_change_counts& b)
+{
+    return {
+        .program = a.program - b.program,
+        .vao = a.vao - b.vao,
+        .texture = a.texture - b.texture,
+        .state = a.state - b.state,
+        .uniforms = a.uniforms - b.uniforms,
+    };
+}
+
+// Estimated cost of executing `next` after `prev` (nullptr for the first draw), like
+// estimate_state_changes would count it with `textures` bound.
+float transition_cost(const DrawPacket* prev, const DrawPacket& next,
+    const std::array<GLuint, 64>& textures, const mugfx_state_change_costs& costs)
+{
+    float cost = 0.0f;
+    if (!prev || next.shader_program != prev->shader_program) {
+        cost += costs.program;
+    }
+    if (!prev || next.vao != prev->vao) {
+        cost += costs.vao;
+    }
+    const auto material_changed = !prev || next.material != prev->material;
+    if (material_changed) {
+        cost += costs.state;
+    }
+    for_each_texture(next, [&](const TextureBinding& tex) {
+        if (tex.unit < textures.size() && textures[tex.unit] != tex.texture) {
+            cost += costs.texture;
+        }
+    });
+    for_each_uniform_data(next, [&](const UniformData* ud) {
+        bool bound = false;
+        if (!material_changed) {
+            for_each_uniform_data(*prev, [&](const UniformData* p) { bound |= p == ud; });
+        }
+        cost += bound ? 0.0f : costs.uniforms;
+    });
+    return cost;
+}
+
+// The draws are first sorted by their state, most expensive kind of state first, which groups the
+// draws that share the expensive state. Then every window of ReorderWindowSize sorted draws is
+// reordered greedily by always picking the draw that is cheapest to execute next, according to the
+// weights. Finding the optimal order would be far too expensive.
+void reorder_draws(
+    const Vector<ReorderDraw>& draws, Vector<uint32_t>& order, Vector<ReorderKey>& keys)
+{
+    constexpr size_t NumKinds = std::tuple_size_v<ReorderKey>;
+    const auto& costs = get_state_change_costs();
+    const std::array<float, NumKinds> weights
+        = { costs.program, costs.vao, costs.texture, costs.state, costs.uniforms };
+    std::array<size_t, NumKinds> kinds = { 0, 1, 2, 3, 4 };
+    std::stable_sort(kinds.begin(), kinds.end(),
+        [&](size_t a, size_t b) { return weights[a] > weights[b]; });
+
+    keys.clear();
+    keys.reserve(draws.size());
+    for (const auto& draw : draws) {
+        uint32_t texture_hash = 0;
+        for_each_texture(draw.packet, [&](const TextureBinding& tex) {
+            texture_hash = inthash(texture_hash ^ inthash(tex.unit << 24 ^ tex.texture));
+        });
+        uint32_t uniform_hash = 0;
+        for_each_uniform_data(draw.packet, [&](const UniformData* ud) {
+            uniform_hash = inthash(uniform_hash ^ pointer_hash(ud));
+        });
+        const ReorderKey state = { draw.packet.shader_program, draw.packet.vao, texture_hash,
+            pointer_hash(draw.packet.material), uniform_hash };
+        ReorderKey key;
+        for (size_t i = 0; i < NumKinds; ++i) {
+            key[i] = state[kinds[i]];
+        }
+        keys.push_back(key);
+    }
+
+    std::stable_sort(order.begin(), order.end(),
+        [&](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+
+    std::array<GLuint, 64> textures;
+    textures.fill(UINT32_MAX);
+    const DrawPacket* prev = nullptr;
+    for (size_t begin = 0; begin < order.size(); begin += ReorderWindowSize) {
+        const auto end = std::min(begin + ReorderWindowSize, order.size());
+        for (size_t i = begin; i < end; ++i) {
+            // Ties go to the earliest draw, so draws with the same state keep their order
+            size_t best = i;
+            auto best_cost = transition_cost(prev, draws[order[i]].packet, textures, costs);
+            for (size_t j = i + 1; j < end && best_cost > 0.0f; ++j) {
+                const auto cost = transition_cost(prev, draws[order[j]].packet, textures, costs);
+                if (cost < best_cost) {
+                    best = j;
+                    best_cost = cost;
+                }
+            }
+            std::rotate(order.begin() + i, order.begin() + best, order.begin() + best + 1);
+            prev = &draws[order[i]].packet;
+            for_each_texture(*prev, [&](const TextureBinding& tex) {
+                if (tex.unit < textures.size()) {
+                    textures[tex.unit] = tex.texture;
+                }
+            });
+        }
+    }
+}
+
+void execute_reorder_group()
+{
+    auto& group = get_reorder_group();
+    auto& stats = get_reorder_stats().current;
+
+    group.order.clear();
+    for (uint32_t i = 0; i < group.draws.size(); ++i) {
+        group.order.push_back(i);
+    }
+    const auto unordered = estimate_state_changes(group.draws, group.order);
+    reorder_draws(group.draws, group.order, group.keys);
+    const auto reordered = estimate_state_changes(group.draws, group.order);
+
+    const auto before = state_changes();
+    for (const auto idx : group.order) {
+        // Skip invalid draws like mugfx_draw would
+        execute_draw_packet(group.draws[idx].packet, group.draws[idx].instance_count);
     }
+    const auto actual = diff(state_changes(), before);
     bind_vao(0);
+
+    stats.num_groups++;
+    stats.num_draws += group.draws.size();
+    add(stats.estimated_unordered, unordered);
+    add(stats.estimated, reordered);
+    add(stats.actual, actual);
+    stats.estimated_cost_unordered += estimate_cost(unordered);
+    stats.estimated_cost += estimate_cost(reordered);
+    group.draws.clear();
+}
 }
 
-void mugfx_draw_instanced(mugfx_material_id material, mugfx_geometry_id geometry,
-    mugfx_draw_binding* bindings, size_t num_bindings, size_t instance_count)
+EXPORT mugfx_binding_set_id mugfx_binding_set_create(mugfx_binding_set_create_params params)
+{
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::BindingSetCreate, params);
+    if (render_thread_defers()) {
+        DeferredData data;
+        const auto offset
+            = data.add(params.bindings, sizeof(mugfx_draw_binding) * params.num_bindings);
+        return { defer_create<BindingSet>("binding set", data, [=](uint8_t* d) mutable {
+            params.bindings = deferred_data<const mugfx_draw_binding>(d, offset);
+            mugfx_binding_set_create(params);
+        }) };
+    }
+
+    if (params.num_bindings > MUGFX_MAX_DRAW_BINDINGS) {
+        log_error("Number of binding set bindings (%lu) exceeds %d", params.num_bindings,
+            MUGFX_MAX_DRAW_BINDINGS);
+        return { 0 };
+    }
+
+    BindingSet set {
+        .num_uniforms = 0,
+        .num_textures = 0,
+        .uniforms = {},
+        .uniform_keys = {},
+        .textures = {},
+        .material_key = 0,
+        .blocks = {},
+        .texture_serial = UINT64_MAX,
+    };
+
+    for (size_t i = 0; i < params.num_bindings; ++i) {
+        const auto& binding = params.bindings[i];
+        if (binding.type == MUGFX_BINDING_TYPE_UNIFORM_DATA) {
+            const auto ud = get_pool<UniformData>().get(binding.uniform_data.id.id);
+            if (!ud) {
+                log_error("Uniform data ID %u does not exist", binding.uniform_data.id.id);
+                return { 0 };
+            }
+            set.uniform_keys[set.num_uniforms] = binding.uniform_data.id.id;
+            set.uniforms[set.num_uniforms++] = ud;
+        } else if (binding.type == MUGFX_BINDING_TYPE_TEXTURE) {
+            const auto tex = resolve_texture_binding(binding);
+            if (!tex) {
+                return { 0 };
+            }
+            set.textures[set.num_textures++] = *tex;
+        } else if (binding.type == MUGFX_BINDING_TYPE_BINDING_SET) {
+            log_error("Binding sets can not contain other binding sets");
+            return { 0 };
+        }
+    }
+
+    const auto key = pool_insert(std::move(set));
+    return { key };
+}
+
+EXPORT void mugfx_binding_set_destroy(mugfx_binding_set_id binding_set)
 {
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::BindingSetDestroy, binding_set);
+    if (render_thread_defers()) {
+        render_thread_defer([=](uint8_t*) { mugfx_binding_set_destroy(binding_set); });
+        return;
+    }
+
+    const auto set = get_pool<BindingSet>().get(binding_set.id);
+    if (!set) {
+        log_error("Binding set ID %u does not exist", binding_set.id);
+        return;
+    }
+    pool_remove<BindingSet>(binding_set.id);
 }
 
-EXPORT void mugfx_flush() { }
+namespace {
+void overdraw_begin_frame(); // with the rest of the overdraw heatmap below
+}
 
-EXPORT void mugfx_end_frame() { }
+EXPORT void mugfx_begin_frame()
+{
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::BeginFrame);
+    if (render_thread_defers()) {
+        render_thread_defer([](uint8_t*) { mugfx_begin_frame(); });
+        return;
+    }
+
+    begin_frame_stats();
+    overdraw_begin_frame();
+}
+
+void mugfx_draw(mugfx_material_id material, mugfx_geometry_id geometry,
+    mugfx_draw_binding* bindings, size_t num_bindings)
+{
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::Draw, material, geometry,
+        CaptureArray<mugfx_draw_binding> { bindings, num_bindings });
+    if (render_thread_defers()) {
+        DeferredData data;
+        const auto offset = data.add(bindings, sizeof(mugfx_draw_binding) * num_bindings);
+        render_thread_defer(data, [=](uint8_t* d) {
+            mugfx_draw(
+                material, geometry, deferred_data<mugfx_draw_binding>(d, offset), num_bindings);
+        });
+        return;
+    }
+
+    DrawPacket packet;
+    if (!resolve_draw_packet(packet, material, geometry, bindings, num_bindings)) {
+        return;
+    }
+    submit_draw_packet(packet, 1);
+    bind_vao(0);
+}
+
+void mugfx_draw_instanced(mugfx_material_id material, mugfx_geometry_id geometry,
+    mugfx_draw_binding* bindings, size_t num_bindings, size_t instance_count)
+{
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::DrawInstanced, material, geometry,
+        CaptureArray<mugfx_draw_binding> { bindings, num_bindings }, instance_count);
+    if (render_thread_defers()) {
+        DeferredData data;
+        const auto offset = data.add(bindings, sizeof(mugfx_draw_binding) * num_bindings);
+        render_thread_defer(data, [=](uint8_t* d) {
+            mugfx_draw_instanced(material, geometry, deferred_data<mugfx_draw_binding>(d, offset),
+                num_bindings, instance_count);
+        });
+        return;
+    }
+
+    DrawPacket packet;
+    if (!resolve_draw_packet(packet, material, geometry, bindings, num_bindings)) {
+        return;
+    }
+    submit_draw_packet(packet, instance_count);
+    bind_vao(0);
+}
+
+EXPORT mugfx_draw_packet_id mugfx_draw_packet_create(mugfx_draw_packet_create_params params)
+{
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::DrawPacketCreate, params);
+    if (render_thread_defers()) {
+        DeferredData data;
+        const auto offset
+            = data.add(params.bindings, sizeof(mugfx_draw_binding) * params.num_bindings);
+        return { defer_create<DrawPacket>("draw packet", data, [=](uint8_t* d) mutable {
+            params.bindings = deferred_data<const mugfx_draw_binding>(d, offset);
+            mugfx_draw_packet_create(params);
+        }) };
+    }
+
+    if (params.num_bindings > MUGFX_MAX_DRAW_BINDINGS) {
+        log_error("Number of draw packet bindings (%lu) exceeds %d", params.num_bindings,
+            MUGFX_MAX_DRAW_BINDINGS);
+        return { 0 };
+    }
+
+    DrawPacket packet;
+    if (!resolve_draw_packet(
+            packet, params.material, params.geometry, params.bindings, params.num_bindings)) {
+        return { 0 };
+    }
+
+    const auto key = pool_insert(std::move(packet));
+    return { key };
+}
+
+EXPORT void mugfx_draw_packet_destroy(mugfx_draw_packet_id packet)
+{
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::DrawPacketDestroy, packet);
+    if (render_thread_defers()) {
+        render_thread_defer([=](uint8_t*) { mugfx_draw_packet_destroy(packet); });
+        return;
+    }
+
+    const auto pkt = get_pool<DrawPacket>().get(packet.id);
+    if (!pkt) {
+        log_error("Draw packet ID %u does not exist", packet.id);
+        return;
+    }
+    pool_remove<DrawPacket>(packet.id);
+}
+
+EXPORT void mugfx_draw_packets(const mugfx_draw_packet_id* packets, size_t num_packets)
+{
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::DrawPackets, CaptureArray<mugfx_draw_packet_id> { packets, num_packets });
+    if (render_thread_defers()) {
+        DeferredData data;
+        const auto offset = data.add(packets, sizeof(mugfx_draw_packet_id) * num_packets);
+        render_thread_defer(data, [=](uint8_t* d) {
+            mugfx_draw_packets(deferred_data<const mugfx_draw_packet_id>(d, offset), num_packets);
+        });
+        return;
+    }
+
+    for (size_t i = 0; i < num_packets; ++i) {
+        const auto packet = get_pool<DrawPacket>().get(packets[i].id);
+        if (!packet) {
+            log_error("Draw packet ID %u does not exist", packets[i].id);
+            continue;
+        }
+        if (!validate_draw_packet(*packet)) {
+            continue;
+        }
+        if (!submit_draw_packet(*packet, 1)) {
+            break;
+        }
+    }
+    bind_vao(0);
+}
+
+EXPORT mugfx_command_list_id mugfx_command_list_create(mugfx_command_list_create_params params)
+{
+    TRACE_FUNCTION();
+    default_init(params);
+
+    const auto key = get_pool<CommandList>().reserve();
+    if (!key) {
+        log_error("Maximum number of command list objects reached");
+        return { 0 };
+    }
+
+    // Allocate everything up front, so recording never needs the allocator
+    reserved_key() = key;
+    return { pool_insert(CommandList {
+        .draws = decltype(CommandList::draws)(params.max_num_draws),
+        .bindings = decltype(CommandList::bindings)(params.max_num_bindings),
+    }) };
+}
+
+EXPORT void mugfx_command_list_destroy(mugfx_command_list_id list)
+{
+    TRACE_FUNCTION();
+    const auto cl = get_pool<CommandList>().get(list.id);
+    if (!cl) {
+        log_error("Command list ID %u does not exist", list.id);
+        return;
+    }
+    pool_remove<CommandList>(list.id);
+}
+
+EXPORT void mugfx_command_list_reset(mugfx_command_list_id list)
+{
+    TRACE_FUNCTION();
+    const auto cl = get_pool<CommandList>().get(list.id);
+    if (!cl) {
+        log_error("Command list ID %u does not exist", list.id);
+        return;
+    }
+    cl->draws.clear();
+    cl->bindings.clear();
+}
+
+EXPORT void mugfx_command_list_draw(mugfx_command_list_id list, mugfx_draw_command command)
+{
+    TRACE_FUNCTION();
+    default_init(command);
+
+    // Pool lookups check the generation atomically, so other lists may be created and destroyed
+    // on other threads meanwhile
+    const auto cl = get_pool<CommandList>().get(list.id);
+    if (!cl) {
+        log_error("Command list ID %u does not exist", list.id);
+        return;
+    }
+
+    if (command.num_bindings > MUGFX_MAX_DRAW_BINDINGS) {
+        log_error("Number of draw command bindings (%lu) exceeds %d", command.num_bindings,
+            MUGFX_MAX_DRAW_BINDINGS);
+        return;
+    }
+
+    if (cl->draws.size() == cl->draws.capacity()) {
+        log_error("Command list is full (%lu draws)", cl->draws.capacity());
+        return;
+    }
+
+    if (cl->bindings.size() + command.num_bindings > cl->bindings.capacity()) {
+        log_error("Command list is full (%lu bindings)", cl->bindings.capacity());
+        return;
+    }
+
+    cl->draws.push_back({
+        .material = command.material,
+        .geometry = command.geometry,
+        .first_binding = cl->bindings.size(),
+        .num_bindings = command.num_bindings,
+        .instance_count = command.instance_count,
+        .sort_key = command.sort_key,
+    });
+    for (size_t i = 0; i < command.num_bindings; ++i) {
+        cl->bindings.push_back(command.bindings[i]);
+    }
+}
+
+namespace {
+struct QueuedDraw {
+    uint64_t sort_key;
+    const CommandList* list;
+    const CommandList::Draw* draw;
+};
+
+Vector<QueuedDraw>& get_draw_queue()
+{
+    static Vector<QueuedDraw> queue;
+    return queue;
+}
+
+// The queued draws of all lists, flattened so they can be copied into a deferred call
+CommandList& get_deferred_flat()
+{
+    static CommandList flat;
+    return flat;
+}
+
+bool execute_draw(const mugfx_draw_binding* bindings, const CommandList::Draw& draw)
+{
+    DrawPacket packet;
+    if (!resolve_draw_packet(packet, draw.material, draw.geometry, bindings + draw.first_binding,
+            draw.num_bindings)) {
+        return false;
+    }
+    return submit_draw_packet(packet, draw.instance_count);
+}
+
+// Command lists are only ever accessed on the game thread in render thread mode, so the queued
+// draws are copied into the deferred call and the lists may be recorded again right away.
+void defer_draws(const Vector<QueuedDraw>& queue)
+{
+    auto& flat = get_deferred_flat();
+    flat.draws.clear();
+    flat.bindings.clear();
+    for (const auto& qd : queue) {
+        auto draw = *qd.draw;
+        draw.first_binding = flat.bindings.size();
+        flat.draws.push_back(draw);
+        for (size_t i = 0; i < draw.num_bindings; ++i) {
+            flat.bindings.push_back(qd.list->bindings[qd.draw->first_binding + i]);
+        }
+    }
+
+    DeferredData data;
+    const auto num_draws = flat.draws.size();
+    const auto draws = data.add(flat.draws.data(), sizeof(CommandList::Draw) * num_draws);
+    const auto bindings
+        = data.add(flat.bindings.data(), sizeof(mugfx_draw_binding) * flat.bindings.size());
+    render_thread_defer(data, [=](uint8_t* d) {
+        const auto draw_data = deferred_data<const CommandList::Draw>(d, draws);
+        const auto binding_data = deferred_data<const mugfx_draw_binding>(d, bindings);
+        for (size_t i = 0; i < num_draws; ++i) {
+            execute_draw(binding_data, draw_data[i]);
+        }
+        bind_vao(0);
+    });
+}
+}
+
+EXPORT void mugfx_command_lists_submit(
+    const mugfx_command_list_id* lists, size_t num_lists, bool sort)
+{
+    TRACE_FUNCTION();
+    auto& queue = get_draw_queue();
+    queue.clear();
+    for (size_t l = 0; l < num_lists; ++l) {
+        const auto cl = get_pool<CommandList>().get(lists[l].id);
+        if (!cl) {
+            log_error("Command list ID %u does not exist", lists[l].id);
+            continue;
+        }
+        for (const auto& draw : cl->draws) {
+            queue.push_back({ draw.sort_key, cl, &draw });
+        }
+    }
+
+    if (sort) {
+        std::stable_sort(queue.begin(), queue.end(),
+            [](const QueuedDraw& a, const QueuedDraw& b) { return a.sort_key < b.sort_key; });
+    }
+
+    // Command lists are not captured, only the draws they submit
+    if (capture_enabled()) {
+        for (const auto& qd : queue) {
+            capture(CaptureCall::DrawInstanced, qd.draw->material, qd.draw->geometry,
+                CaptureArray<mugfx_draw_binding> {
+                    qd.list->bindings.data() + qd.draw->first_binding, qd.draw->num_bindings },
+                qd.draw->instance_count);
+        }
+    }
+
+    if (render_thread_defers()) {
+        defer_draws(queue);
+        return;
+    }
+
+    for (const auto& qd : queue) {
+        // Skip invalid draws like mugfx_draw would
+        execute_draw(qd.list->bindings.data(), *qd.draw);
+    }
+    bind_vao(0);
+}
+
+EXPORT void mugfx_reorder_group_begin()
+{
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::ReorderGroupBegin);
+    if (render_thread_defers()) {
+        render_thread_defer([](uint8_t*) { mugfx_reorder_group_begin(); });
+        return;
+    }
+
+    auto& group = get_reorder_group();
+    if (group.active) {
+        log_error("Reorder groups can not be nested");
+        return;
+    }
+    group.active = true;
+}
+
+EXPORT void mugfx_reorder_group_end()
+{
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::ReorderGroupEnd);
+    if (render_thread_defers()) {
+        render_thread_defer([](uint8_t*) { mugfx_reorder_group_end(); });
+        return;
+    }
+
+    auto& group = get_reorder_group();
+    if (!group.active) {
+        log_error("No reorder group to end");
+        return;
+    }
+    group.active = false;
+    execute_reorder_group();
+}
+
+EXPORT mugfx_reorder_stats mugfx_get_reorder_stats()
+{
+    TRACE_FUNCTION();
+    auto& stats = get_reorder_stats();
+    std::lock_guard lock(stats.mutex);
+    return stats.last_frame;
+}
+
+namespace {
+struct GpuScope {
+    const char* name;
+    uint32_t parent;
+    uint32_t depth;
+    GLuint begin_query;
+    GLuint end_query;
+};
+
+// GL_ARB_pipeline_statistics_query is not part of glad's OpenGL 3.3
+constexpr GLenum GL_VERTEX_SHADER_INVOCATIONS_ARB = 0x82F0;
+constexpr GLenum GL_FRAGMENT_SHADER_INVOCATIONS_ARB = 0x82F4;
+constexpr GLenum GL_CLIPPING_INPUT_PRIMITIVES_ARB = 0x82F6;
+constexpr GLenum GL_CLIPPING_OUTPUT_PRIMITIVES_ARB = 0x82F7;
+
+constexpr size_t MaxStatistics = 6;
+
+// Unlike timestamps, statistics are counted by begin/end queries, of which only one per target can
+// be active. So every begin and end of a scope ends the current segment and starts a new one, which
+// is counted for the innermost open scope. Collecting adds the segments to their scopes and then
+// every scope to its parent.
+struct StatisticsSegment {
+    uint32_t scope;
+    std::array<GLuint, MaxStatistics> queries;
+};
+
+struct GpuFrame {
+    uint64_t frame = 0;
+    bool pending = false; // waiting for its query results
+    Vector<GpuScope> scopes;
+    Vector<StatisticsSegment> segments;
+};
+
+struct GpuProfiler {
+    // Results are usually available after one or two frames. If they take longer, the frame is
+    // dropped instead of waiting for it.
+    std::array<GpuFrame, 4> frames;
+    size_t current = 0;
+    uint64_t frame_counter = 0;
+    Vector<uint32_t> open_scopes;
+    Vector<GLuint> free_queries;
+    Vector<uint64_t> timestamps;
+    // A query object can only be used with a single target, so every statistic has its own queries
+    std::array<GLenum, MaxStatistics> statistics = {};
+    size_t num_statistics = 0;
+    std::array<Vector<GLuint>, MaxStatistics> free_statistics_queries;
+    Vector<uint64_t> statistics_values;
+
+    std::mutex mutex; // guards results, which are read from the game thread
+    Vector<mugfx_gpu_scope_timing> results;
+    uint64_t results_frame = 0;
+};
+
+GpuProfiler& get_gpu_profiler()
+{
+    static GpuProfiler profiler;
+    return profiler;
+}
+
+bool gpu_profiling_supported()
+{
+    return glQueryCounter && glGetQueryObjectui64v;
+}
+
+void init_gpu_profiler(bool pipeline_statistics)
+{
+    auto& prof = get_gpu_profiler();
+    prof.num_statistics = 0;
+    if (!pipeline_statistics) {
+        return;
+    }
+    prof.statistics[prof.num_statistics++] = GL_SAMPLES_PASSED;
+    prof.statistics[prof.num_statistics++] = GL_PRIMITIVES_GENERATED;
+    const auto version = GLVersion.major * 10 + GLVersion.minor;
+    if (version >= 46 || has_gl_extension("GL_ARB_pipeline_statistics_query")) {
+        prof.statistics[prof.num_statistics++] = GL_VERTEX_SHADER_INVOCATIONS_ARB;
+        prof.statistics[prof.num_statistics++] = GL_FRAGMENT_SHADER_INVOCATIONS_ARB;
+        prof.statistics[prof.num_statistics++] = GL_CLIPPING_INPUT_PRIMITIVES_ARB;
+        prof.statistics[prof.num_statistics++] = GL_CLIPPING_OUTPUT_PRIMITIVES_ARB;
+    } else {
+        log_warn("GL_ARB_pipeline_statistics_query is not supported, so only samples and "
+                 "primitives are counted");
+    }
+}
+
+uint64_t& get_statistic(mugfx_gpu_scope_timing& timing, GLenum statistic)
+{
+    switch (statistic) {
+    case GL_SAMPLES_PASSED:
+        return timing.samples_passed;
+    case GL_PRIMITIVES_GENERATED:
+        return timing.primitives_generated;
+    case GL_VERTEX_SHADER_INVOCATIONS_ARB:
+        return timing.vertex_shader_invocations;
+    case GL_FRAGMENT_SHADER_INVOCATIONS_ARB:
+        return timing.fragment_shader_invocations;
+    case GL_CLIPPING_INPUT_PRIMITIVES_ARB:
+        return timing.clipping_input_primitives;
+    case GL_CLIPPING_OUTPUT_PRIMITIVES_ARB:
+        return timing.clipping_output_primitives;
+    default:
+        assert(false && "Invalid statistic");
+        return timing.samples_passed;
+    }
+}
+
+GLuint get_query(Vector<GLuint>& free_queries)
+{
+    if (free_queries.empty()) {
+        std::array<GLuint, 32> queries;
+        glGenQueries(queries.size(), queries.data());
+        for (const auto query : queries) {
+            free_queries.push_back(query);
+        }
+    }
+    const auto query = free_queries.back();
+    free_queries.pop_back();
+    return query;
+}
+
+void release_queries(GpuProfiler& prof, GpuFrame& frame)
+{
+    for (const auto& scope : frame.scopes) {
+        prof.free_queries.push_back(scope.begin_query);
+        prof.free_queries.push_back(scope.end_query);
+    }
+    for (const auto& segment : frame.segments) {
+        for (size_t i = 0; i < prof.num_statistics; ++i) {
+            prof.free_statistics_queries[i].push_back(segment.queries[i]);
+        }
+    }
+    frame.scopes.clear();
+    frame.segments.clear();
+    frame.pending = false;
+}
+
+void begin_statistics_segment(GpuProfiler& prof)
+{
+    if (prof.num_statistics == 0 || prof.open_scopes.empty()) {
+        return;
+    }
+    StatisticsSegment segment { .scope = prof.open_scopes.back(), .queries = {} };
+    for (size_t i = 0; i < prof.num_statistics; ++i) {
+        segment.queries[i] = get_query(prof.free_statistics_queries[i]);
+        glBeginQuery(prof.statistics[i], segment.queries[i]);
+    }
+    prof.frames[prof.current].segments.push_back(segment);
+}
+
+void end_statistics_segment(GpuProfiler& prof)
+{
+    if (prof.num_statistics == 0 || prof.open_scopes.empty()) {
+        return;
+    }
+    for (size_t i = 0; i < prof.num_statistics; ++i) {
+        glEndQuery(prof.statistics[i]);
+    }
+}
+
+bool query_available(GLuint query)
+{
+    GLuint available = GL_FALSE;
+    glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+    return available == GL_TRUE;
+}
+
+// Returns false if the results are not available yet
+bool collect_gpu_frame(GpuProfiler& prof, GpuFrame& frame)
+{
+    // Check the last query first, because it is usually the last to become available
+    if (!frame.scopes.empty() && !query_available(frame.scopes.back().end_query)) {
+        return false;
+    }
+    for (const auto& scope : frame.scopes) {
+        if (!query_available(scope.begin_query) || !query_available(scope.end_query)) {
+            return false;
+        }
+    }
+    for (const auto& segment : frame.segments) {
+        for (size_t i = 0; i < prof.num_statistics; ++i) {
+            if (!query_available(segment.queries[i])) {
+                return false;
+            }
+        }
+    }
+
+    prof.timestamps.clear();
+    for (const auto& scope : frame.scopes) {
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(scope.begin_query, GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(scope.end_query, GL_QUERY_RESULT, &end);
+        prof.timestamps.push_back(begin);
+        prof.timestamps.push_back(end);
+    }
+    prof.statistics_values.clear();
+    for (const auto& segment : frame.segments) {
+        for (size_t i = 0; i < prof.num_statistics; ++i) {
+            GLuint64 value = 0;
+            glGetQueryObjectui64v(segment.queries[i], GL_QUERY_RESULT, &value);
+            prof.statistics_values.push_back(value);
+        }
+    }
+
+    const auto frame_start = prof.timestamps.empty() ? 0 : prof.timestamps[0];
+    std::lock_guard lock(prof.mutex);
+    prof.results.clear();
+    for (size_t i = 0; i < frame.scopes.size(); ++i) {
+        const auto begin = prof.timestamps[2 * i];
+        const auto end = prof.timestamps[2 * i + 1];
+        prof.results.push_back({
+            .name = frame.scopes[i].name,
+            .parent = frame.scopes[i].parent,
+            .depth = frame.scopes[i].depth,
+            .start_ns = begin - frame_start,
+            .time_ns = end > begin ? end - begin : 0,
+            .samples_passed = 0,
+            .primitives_generated = 0,
+            .vertex_shader_invocations = 0,
+            .fragment_shader_invocations = 0,
+            .clipping_input_primitives = 0,
+            .clipping_output_primitives = 0,
+        });
+    }
+    for (size_t s = 0; s < frame.segments.size(); ++s) {
+        auto& result = prof.results[frame.segments[s].scope];
+        for (size_t i = 0; i < prof.num_statistics; ++i) {
+            get_statistic(result, prof.statistics[i])
+                += prof.statistics_values[s * prof.num_statistics + i];
+        }
+    }
+    // Children are always after their parents, so they are complete before they are added
+    for (size_t i = prof.results.size(); i-- > 0;) {
+        const auto parent = prof.results[i].parent;
+        if (parent != UINT32_MAX) {
+            for (size_t j = 0; j < prof.num_statistics; ++j) {
+                get_statistic(prof.results[parent], prof.statistics[j])
+                    += get_statistic(prof.results[i], prof.statistics[j]);
+            }
+        }
+    }
+    prof.results_frame = frame.frame;
+    return true;
+}
+
+void end_gpu_frame()
+{
+    auto& prof = get_gpu_profiler();
+    if (!prof.open_scopes.empty()) {
+        log_error("%lu GPU scopes were not closed before the end of the frame",
+            prof.open_scopes.size());
+        while (!prof.open_scopes.empty()) {
+            mugfx_gpu_scope_end();
+        }
+    }
+
+    auto& current = prof.frames[prof.current];
+    current.frame = prof.frame_counter++;
+    current.pending = !current.scopes.empty();
+
+    // Collect in submission order, so the newest available frame is published last
+    for (size_t i = 1; i <= prof.frames.size(); ++i) {
+        auto& frame = prof.frames[(prof.current + i) % prof.frames.size()];
+        if (frame.pending) {
+            if (!collect_gpu_frame(prof, frame)) {
+                break;
+            }
+            release_queries(prof, frame);
+        }
+    }
+
+    prof.current = (prof.current + 1) % prof.frames.size();
+    auto& next = prof.frames[prof.current];
+    if (next.pending) {
+        log_warn("Dropping GPU timings of frame %lu, because they are not available yet",
+            next.frame);
+        release_queries(prof, next);
+    }
+}
+
+void gpu_scope_begin(Atom name)
+{
+    if (!gpu_profiling_supported()) {
+        return;
+    }
+    auto& prof = get_gpu_profiler();
+    auto& frame = prof.frames[prof.current];
+    end_statistics_segment(prof);
+    const auto parent = prof.open_scopes.empty() ? UINT32_MAX : prof.open_scopes.back();
+    prof.open_scopes.push_back(static_cast<uint32_t>(frame.scopes.size()));
+    frame.scopes.push_back({
+        .name = atom_str(name),
+        .parent = parent,
+        .depth = static_cast<uint32_t>(prof.open_scopes.size() - 1),
+        .begin_query = get_query(prof.free_queries),
+        .end_query = 0,
+    });
+    glQueryCounter(frame.scopes.back().begin_query, GL_TIMESTAMP);
+    begin_statistics_segment(prof);
+}
+}
+
+EXPORT void mugfx_gpu_scope_begin(const char* name)
+{
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::GpuScopeBegin, name);
+    if (!name) {
+        log_error("GPU scope name must not be null");
+        return;
+    }
+    // The name is returned with the timings frames later, so it has to outlive the caller's string
+    const auto atom = intern(name);
+    if (render_thread_defers()) {
+        render_thread_defer([=](uint8_t*) { gpu_scope_begin(atom); });
+        return;
+    }
+    gpu_scope_begin(atom);
+}
+
+EXPORT void mugfx_gpu_scope_end()
+{
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::GpuScopeEnd);
+    if (render_thread_defers()) {
+        render_thread_defer([](uint8_t*) { mugfx_gpu_scope_end(); });
+        return;
+    }
+
+    if (!gpu_profiling_supported()) {
+        return;
+    }
+    auto& prof = get_gpu_profiler();
+    if (prof.open_scopes.empty()) {
+        log_error("No GPU scope to end");
+        return;
+    }
+    end_statistics_segment(prof);
+    auto& scope = prof.frames[prof.current].scopes[prof.open_scopes.back()];
+    prof.open_scopes.pop_back();
+    scope.end_query = get_query(prof.free_queries);
+    glQueryCounter(scope.end_query, GL_TIMESTAMP);
+    begin_statistics_segment(prof);
+}
+
+EXPORT size_t mugfx_get_gpu_timings(
+    mugfx_gpu_scope_timing* scopes, size_t max_scopes, uint64_t* frame)
+{
+    TRACE_FUNCTION();
+    auto& prof = get_gpu_profiler();
+    std::lock_guard lock(prof.mutex);
+    const auto count = std::min(max_scopes, prof.results.size());
+    if (count > 0) {
+        std::memcpy(scopes, prof.results.data(), sizeof(mugfx_gpu_scope_timing) * count);
+    }
+    if (frame) {
+        *frame = prof.results_frame;
+    }
+    return prof.results.size();
+}
+
+namespace {
+void shutdown_gpu_profiler()
+{
+    auto& prof = get_gpu_profiler();
+    for (auto& frame : prof.frames) {
+        release_queries(prof, frame);
+        frame = {};
+    }
+    glDeleteQueries(prof.free_queries.size(), prof.free_queries.data());
+    prof.free_queries = {};
+    for (auto& queries : prof.free_statistics_queries) {
+        glDeleteQueries(queries.size(), queries.data());
+        queries = {};
+    }
+    prof.current = 0;
+    prof.frame_counter = 0;
+    prof.open_scopes = {};
+    prof.timestamps = {};
+    prof.num_statistics = 0;
+    prof.statistics_values = {};
+
+    std::lock_guard lock(prof.mutex);
+    prof.results = {};
+    prof.results_frame = 0;
+}
+
+// Draws a triangle that covers the whole viewport with a single color
+const auto overdraw_vert_source = R"(
+    #version 330 core
+
+    void main() {
+        vec2 position = vec2(gl_VertexID == 1 ? 3.0 : -1.0, gl_VertexID == 2 ? 3.0 : -1.0);
+        gl_Position = vec4(position, 0.0, 1.0);
+    }
+)";
+
+const auto overdraw_frag_source = R"(
+    #version 330 core
+
+    uniform vec4 u_color;
+
+    out vec4 frag_color;
+
+    void main() {
+        frag_color = u_color;
+    }
+)";
+
+// The counts are resolved with one pass per level, which colors every pixel with a count of at
+// least that level (stencil test GL_LEQUAL). The samples passed by each of these passes are the
+// histogram.
+struct OverdrawFrame {
+    uint64_t frame = 0;
+    bool pending = false; // waiting for its query results
+    uint32_t levels = 0;
+    size_t pixels = 0;
+    std::array<GLuint, MUGFX_MAX_OVERDRAW> queries = {};
+};
+
+struct Overdraw {
+    // Created by the calling thread, so the heatmap has an ID right away in render thread mode
+    mugfx_texture_id heatmap = { 0 };
+    mugfx_shader_id vert_shader = { 0 };
+    mugfx_shader_id frag_shader = { 0 };
+    mugfx_material_id material = { 0 };
+
+    mugfx_overdraw_params params = {};
+    bool active = false; // the current frame is counted
+    GLuint framebuffer = 0;
+    GLuint depth_stencil = 0;
+    GLuint vao = 0;
+    GLint color_location = -1;
+    size_t width = 0;
+    size_t height = 0;
+    std::array<OverdrawFrame, 4> frames;
+    size_t current = 0;
+    uint64_t frame_counter = 0;
+
+    std::mutex mutex; // guards results, which are read from the game thread
+    mugfx_overdraw_stats results = {};
+};
+
+Overdraw& get_overdraw()
+{
+    static Overdraw overdraw;
+    return overdraw;
+}
+
+// Black (not covered), then blue, cyan, green, yellow and red for t = 1
+std::array<float, 4> heatmap_color(float t)
+{
+    static constexpr std::array<std::array<float, 3>, 5> ramp = { {
+        { 0.0f, 0.0f, 1.0f },
+        { 0.0f, 1.0f, 1.0f },
+        { 0.0f, 1.0f, 0.0f },
+        { 1.0f, 1.0f, 0.0f },
+        { 1.0f, 0.0f, 0.0f },
+    } };
+    const auto x = t * static_cast<float>(ramp.size() - 1);
+    const auto i = std::min(static_cast<size_t>(x), ramp.size() - 2);
+    const auto f = x - static_cast<float>(i);
+    std::array<float, 4> color = { 0.0f, 0.0f, 0.0f, 1.0f };
+    for (size_t c = 0; c < 3; ++c) {
+        color[c] = ramp[i][c] + (ramp[i + 1][c] - ramp[i][c]) * f;
+    }
+    return color;
+}
+
+bool init_overdraw(Overdraw& od)
+{
+    const auto material = get_pool<Material>().get(od.material.id);
+    if (!material) {
+        log_error("Overdraw material does not exist");
+        return false;
+    }
+    od.color_location = glGetUniformLocation(material->shader_program, "u_color");
+
+    glGenFramebuffers(1, &od.framebuffer);
+    glGenRenderbuffers(1, &od.depth_stencil);
+    // Core profile can't draw without a VAO, even if there are no attributes
+    glGenVertexArrays(1, &od.vao);
+    for (auto& frame : od.frames) {
+        glGenQueries(frame.queries.size(), frame.queries.data());
+    }
+    if (const auto error = get_gl_error()) {
+        log_error("Error creating overdraw framebuffer: %s", gl_error_string(error));
+        return false;
+    }
+    label_object(GL_FRAMEBUFFER, od.framebuffer, "mugfx overdraw");
+    return true;
+}
+
+bool resize_overdraw(Overdraw& od, size_t width, size_t height)
+{
+    const auto tex = get_pool<Texture>().get(od.heatmap.id);
+    if (!tex) {
+        log_error("Overdraw heatmap texture ID %u does not exist", od.heatmap.id);
+        return false;
+    }
+    const auto w = static_cast<GLsizei>(width);
+    const auto h = static_cast<GLsizei>(height);
+    if (!bind_texture(0, tex->target, tex->texture)) {
+        return false;
+    }
+    glTexImage2D(tex->target, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    count_memory(*tex, false);
+    tex->width = width;
+    tex->height = height;
+    tex->gpu_bytes = get_texture_size(MUGFX_PIXEL_FORMAT_RGBA8, width, height, false);
+    count_memory(*tex, true);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, od.depth_stencil);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, w, h);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, od.framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, tex->target, tex->texture, 0);
+    glFramebufferRenderbuffer(
+        GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, od.depth_stencil);
+    const auto status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        log_error("Overdraw framebuffer is incomplete: 0x%X", status);
+        return false;
+    }
+    od.width = width;
+    od.height = height;
+    return true;
+}
+
+void overdraw_begin_frame()
+{
+    auto& od = get_overdraw();
+    if (!od.params.enabled) {
+        return;
+    }
+    if (!od.framebuffer && !init_overdraw(od)) {
+        od.params.enabled = false;
+        return;
+    }
+
+    const auto& viewport = current_viewport();
+    const auto width
+        = std::max(static_cast<size_t>(std::max(viewport.x, 0)) + viewport.width, size_t { 1 });
+    const auto height
+        = std::max(static_cast<size_t>(std::max(viewport.y, 0)) + viewport.height, size_t { 1 });
+    if ((width != od.width || height != od.height) && !resize_overdraw(od, width, height)) {
+        od.params.enabled = false;
+        return;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, od.framebuffer);
+    // glClearBuffer does not change the clear values of the application
+    const std::array<GLfloat, 4> black = { 0.0f, 0.0f, 0.0f, 1.0f };
+    glClearBufferfv(GL_COLOR, 0, black.data());
+    const GLfloat depth = 1.0f;
+    glClearBufferfv(GL_DEPTH, 0, &depth);
+    const GLint stencil = 0;
+    glClearBufferiv(GL_STENCIL, 0, &stencil);
+
+    glEnable(GL_STENCIL_TEST);
+    glStencilFunc(GL_ALWAYS, 0, 0xFF);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    od.active = true;
+}
+
+void resolve_overdraw(Overdraw& od, OverdrawFrame& frame)
+{
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+
+    const auto material = get_pool<Material>().get(od.material.id);
+    if (material && bind_shader(material->shader_program) && bind_vao(od.vao)) {
+        frame.levels = od.params.max_overdraw;
+        frame.pixels = od.width * od.height;
+        for (uint32_t level = 1; level <= frame.levels; ++level) {
+            glStencilFunc(GL_LEQUAL, static_cast<GLint>(level), 0xFF);
+            const auto t = static_cast<float>(level) / static_cast<float>(frame.levels);
+            glUniform4fv(od.color_location, 1, heatmap_color(t).data());
+            glBeginQuery(GL_SAMPLES_PASSED, frame.queries[level - 1]);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            glEndQuery(GL_SAMPLES_PASSED);
+        }
+        bind_vao(0);
+        frame.pending = true;
+    }
+    glDisable(GL_STENCIL_TEST);
+
+    if (od.params.present) {
+        const auto w = static_cast<GLint>(od.width);
+        const auto h = static_cast<GLint>(od.height);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, od.framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, w, h, 0, 0, w, h, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (const auto error = get_gl_error()) {
+        log_error("Error resolving overdraw: %s", gl_error_string(error));
+    }
+}
+
+// Returns false if the results are not available yet
+bool collect_overdraw_frame(Overdraw& od, const OverdrawFrame& frame)
+{
+    // The last level is the last query to become available
+    for (uint32_t i = frame.levels; i-- > 0;) {
+        if (!query_available(frame.queries[i])) {
+            return false;
+        }
+    }
+
+    mugfx_overdraw_stats stats = {};
+    stats.frame = frame.frame;
+    stats.pixels = frame.pixels;
+    for (uint32_t i = 0; i < frame.levels; ++i) {
+        GLuint64 pixels = 0;
+        glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &pixels);
+        stats.histogram[i] = pixels;
+        stats.fragments += pixels;
+        if (pixels > 0) {
+            stats.max_overdraw = i + 1;
+        }
+    }
+    stats.covered_pixels = stats.histogram[0];
+    if (stats.covered_pixels > 0) {
+        stats.average_overdraw
+            = static_cast<float>(stats.fragments) / static_cast<float>(stats.covered_pixels);
+    }
+
+    std::lock_guard lock(od.mutex);
+    od.results = stats;
+    return true;
+}
+
+void overdraw_end_frame()
+{
+    auto& od = get_overdraw();
+    const auto frame_number = od.frame_counter++;
+    if (od.active) {
+        auto& frame = od.frames[od.current];
+        if (frame.pending) {
+            log_warn("Dropping overdraw statistics of frame %lu, because they are not available",
+                frame.frame);
+            frame.pending = false;
+        }
+        frame.frame = frame_number;
+        resolve_overdraw(od, frame);
+        od.current = (od.current + 1) % od.frames.size();
+        od.active = false;
+    }
+
+    // od.current is the oldest frame. Collect in submission order, so the newest available frame
+    // is published last.
+    for (size_t i = 0; i < od.frames.size(); ++i) {
+        auto& frame = od.frames[(od.current + i) % od.frames.size()];
+        if (frame.pending) {
+            if (!collect_overdraw_frame(od, frame)) {
+                break;
+            }
+            frame.pending = false;
+        }
+    }
+}
+
+// These were created with the public functions, so they are not destroyed as leaks later
+void destroy_overdraw_resources(Overdraw& od)
+{
+    if (od.material.id) {
+        mugfx_material_destroy(od.material);
+    }
+    if (od.vert_shader.id) {
+        mugfx_shader_destroy(od.vert_shader);
+    }
+    if (od.frag_shader.id) {
+        mugfx_shader_destroy(od.frag_shader);
+    }
+    if (od.heatmap.id) {
+        mugfx_texture_destroy(od.heatmap);
+    }
+    od.heatmap = { 0 };
+    od.vert_shader = { 0 };
+    od.frag_shader = { 0 };
+    od.material = { 0 };
+}
+}
+
+EXPORT void mugfx_set_overdraw_mode(mugfx_overdraw_params params)
+{
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::SetOverdrawMode, params);
+    default_init(params);
+    if (params.max_overdraw > MUGFX_MAX_OVERDRAW) {
+        log_error("max_overdraw must be at most %d", MUGFX_MAX_OVERDRAW);
+        return;
+    }
+
+    auto& od = get_overdraw();
+    if (params.enabled && !od.heatmap.id) {
+        // Resized in mugfx_begin_frame
+        mugfx_texture_create_params heatmap_params = {};
+        heatmap_params.width = 1;
+        heatmap_params.height = 1;
+        heatmap_params.min_filter = MUGFX_TEXTURE_MIN_FILTER_NEAREST;
+        heatmap_params.mag_filter = MUGFX_TEXTURE_MAG_FILTER_NEAREST;
+        heatmap_params.label = "mugfx overdraw heatmap";
+        od.heatmap = mugfx_texture_create(heatmap_params);
+
+        if (od.heatmap.id) {
+            mugfx_shader_create_params shader_params = {};
+            shader_params.stage = MUGFX_SHADER_STAGE_VERTEX;
+            shader_params.source = overdraw_vert_source;
+            od.vert_shader = mugfx_shader_create(shader_params);
+            shader_params.stage = MUGFX_SHADER_STAGE_FRAGMENT;
+            shader_params.source = overdraw_frag_source;
+            od.frag_shader = mugfx_shader_create(shader_params);
+        }
+
+        if (od.vert_shader.id && od.frag_shader.id) {
+            mugfx_material_create_params material_params = {};
+            material_params.vert_shader = od.vert_shader;
+            material_params.frag_shader = od.frag_shader;
+            material_params.label = "mugfx overdraw resolve";
+            od.material = mugfx_material_create(material_params);
+        }
+
+        // The material is created last, so everything else exists if it does
+        if (!od.material.id) { // already logged an error
+            // Destroy what was created, so the next call starts over
+            destroy_overdraw_resources(od);
+            return;
+        }
+    }
+
+    if (render_thread_defers()) {
+        render_thread_defer([=](uint8_t*) { mugfx_set_overdraw_mode(params); });
+        return;
+    }
+
+    od.params = params;
+}
+
+EXPORT mugfx_texture_id mugfx_get_overdraw_heatmap()
+{
+    TRACE_FUNCTION();
+    return get_overdraw().heatmap;
+}
+
+EXPORT mugfx_overdraw_stats mugfx_get_overdraw_stats()
+{
+    TRACE_FUNCTION();
+    auto& od = get_overdraw();
+    std::lock_guard lock(od.mutex);
+    return od.results;
+}
+
+namespace {
+void shutdown_overdraw()
+{
+    auto& od = get_overdraw();
+    if (od.framebuffer) {
+        glDeleteFramebuffers(1, &od.framebuffer);
+        glDeleteRenderbuffers(1, &od.depth_stencil);
+        glDeleteVertexArrays(1, &od.vao);
+        for (auto& frame : od.frames) {
+            glDeleteQueries(frame.queries.size(), frame.queries.data());
+            frame = {};
+        }
+    }
+    destroy_overdraw_resources(od);
+    od.params = {};
+    od.active = false;
+    od.framebuffer = 0;
+    od.depth_stencil = 0;
+    od.vao = 0;
+    od.color_location = -1;
+    od.width = 0;
+    od.height = 0;
+    od.current = 0;
+    od.frame_counter = 0;
+
+    std::lock_guard lock(od.mutex);
+    od.results = {};
+}
+}
+
+namespace {
+// GL_NVX_gpu_memory_info and GL_ATI_meminfo are not in glad
+constexpr GLenum GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX = 0x9048;
+constexpr GLenum GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX = 0x9049;
+constexpr GLenum GL_TEXTURE_FREE_MEMORY_ATI = 0x87FC;
+
+enum class DriverMemoryInfo { None, Nvx, Ati };
+
+struct DriverMemory {
+    DriverMemoryInfo info = DriverMemoryInfo::None;
+    // Written on the render thread, read on the game thread
+    std::atomic<size_t> total_bytes = 0;
+    std::atomic<size_t> available_bytes = 0;
+};
+
+DriverMemory& get_driver_memory()
+{
+    static DriverMemory memory;
+    return memory;
+}
+
+void init_driver_memory()
+{
+    auto& mem = get_driver_memory();
+    if (has_gl_extension("GL_NVX_gpu_memory_info")) {
+        mem.info = DriverMemoryInfo::Nvx;
+    } else if (has_gl_extension("GL_ATI_meminfo")) {
+        mem.info = DriverMemoryInfo::Ati;
+    } else {
+        mem.info = DriverMemoryInfo::None;
+    }
+}
+
+// Both extensions report KiB
+void update_driver_memory()
+{
+    auto& mem = get_driver_memory();
+    if (mem.info == DriverMemoryInfo::Nvx) {
+        GLint total = 0;
+        GLint available = 0;
+        glGetIntegerv(GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX, &total);
+        glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, &available);
+        mem.total_bytes = static_cast<size_t>(total) * 1024;
+        mem.available_bytes = static_cast<size_t>(available) * 1024;
+    } else if (mem.info == DriverMemoryInfo::Ati) {
+        // Free memory in the texture pool, largest free block, free auxiliary memory, largest
+        // free auxiliary block
+        std::array<GLint, 4> free = {};
+        glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, free.data());
+        mem.available_bytes = static_cast<size_t>(free[0]) * 1024;
+    }
+}
+
+template <typename T>
+mugfx_resource_memory get_resource_memory()
+{
+    if (!get_pool_storage<T>()) {
+        return {};
+    }
+    auto& pool = get_pool<T>();
+    const auto& memory = get_pool_memory<T>();
+    return {
+        .count = pool.size(),
+        .high_water = pool.high_water(),
+        .capacity = pool.capacity(),
+        .gpu_bytes = memory.gpu_bytes,
+        .cpu_bytes = pool.allocated_bytes() + memory.cpu_bytes,
+    };
+}
+}
+
+EXPORT mugfx_memory_stats mugfx_get_memory_stats()
+{
+    TRACE_FUNCTION();
+    mugfx_memory_stats stats = {};
+    stats.shaders = get_resource_memory<Shader>();
+    stats.textures = get_resource_memory<Texture>();
+    stats.materials = get_resource_memory<Material>();
+    stats.buffers = get_resource_memory<Buffer>();
+    stats.uniform_data = get_resource_memory<UniformData>();
+    stats.geometries = get_resource_memory<Geometry>();
+    stats.draw_packets = get_resource_memory<DrawPacket>();
+    stats.binding_sets = get_resource_memory<BindingSet>();
+    stats.command_lists = get_resource_memory<CommandList>();
+    for (const auto& res : { stats.shaders, stats.textures, stats.materials, stats.buffers,
+             stats.uniform_data, stats.geometries, stats.draw_packets, stats.binding_sets,
+             stats.command_lists }) {
+        stats.gpu_bytes += res.gpu_bytes;
+    }
+    const auto allocation = get_allocation_stats();
+    stats.cpu_bytes = allocation.bytes;
+    stats.cpu_bytes_peak = allocation.peak_bytes;
+    for (size_t i = 0; i < MUGFX_ALLOCATION_TAG_COUNT; ++i) {
+        stats.allocations[i] = get_allocation_stats(static_cast<mugfx_allocation_tag>(i));
+    }
+    const auto& driver = get_driver_memory();
+    stats.driver_total_bytes = driver.total_bytes;
+    stats.driver_available_bytes = driver.available_bytes;
+    return stats;
+}
+
+EXPORT void mugfx_push_group(const char* name)
+{
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::PushGroup, name);
+    if (render_thread_defers()) {
+        DeferredData data;
+        const auto offset = data.add(name);
+        render_thread_defer(data, [=](uint8_t* d) {
+            mugfx_push_group(deferred_data<const char>(d, offset));
+        });
+        return;
+    }
+
+    if (debug_labels_enabled()) {
+        glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+    }
+}
+
+EXPORT void mugfx_pop_group()
+{
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::PopGroup);
+    if (render_thread_defers()) {
+        render_thread_defer([](uint8_t*) { mugfx_pop_group(); });
+        return;
+    }
+
+    if (debug_labels_enabled()) {
+        glPopDebugGroup();
+    }
+}
+
+EXPORT void mugfx_flush()
+{
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::Flush);
+    if (render_thread_defers()) {
+        render_thread_defer([](uint8_t*) { mugfx_flush(); });
+        return;
+    }
+}
+
+EXPORT void mugfx_end_frame()
+{
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::EndFrame);
+    if (render_thread_defers()) {
+        render_thread_end_frame();
+        return;
+    }
+
+    end_frame_stats();
+
+    if (gpu_profiling_supported()) {
+        end_gpu_frame();
+    }
+
+    update_driver_memory();
+
+    // After the frame stats, so the resolve is not counted
+    overdraw_end_frame();
+
+    auto& stats = get_reorder_stats();
+    {
+        std::lock_guard lock(stats.mutex);
+        stats.last_frame = stats.current;
+    }
+    stats.current = {};
+}
+
+namespace {
+template <typename T, typename Id>
+void destroy_leaked(const char* type_name, void (*destroy)(Id))
+{
+    size_t count = 0;
+    get_pool<T>().for_each_key([&](uint32_t key) {
+        log_debug("%s ID %u was not destroyed", type_name, key);
+        destroy(Id { key });
+        count++;
+    });
+    if (count > 0) {
+        log_warn("%zu %s objects were not destroyed before mugfx_shutdown", count, type_name);
+    }
+}
+
+// Everything that needs the context
+void shutdown_gl()
+{
+    shutdown_overdraw();
+    shutdown_gpu_profiler();
+
+    // Objects that use other objects first
+    destroy_leaked<DrawPacket>("draw packet", mugfx_draw_packet_destroy);
+    destroy_leaked<BindingSet>("binding set", mugfx_binding_set_destroy);
+    destroy_leaked<CommandList>("command list", mugfx_command_list_destroy);
+    destroy_leaked<Geometry>("geometry", mugfx_geometry_destroy);
+    destroy_leaked<Material>("material", mugfx_material_destroy);
+    destroy_leaked<UniformData>("uniform data", mugfx_uniform_data_destroy);
+    destroy_leaked<Shader>("shader", mugfx_shader_destroy);
+    destroy_leaked<Buffer>("buffer", mugfx_buffer_destroy);
+    destroy_leaked<Texture>("texture", mugfx_texture_destroy);
+
+    auto& group = get_reorder_group();
+    group.active = false;
+    group.draws = {};
+    group.order = {};
+    group.keys = {};
+    auto& stats = get_reorder_stats();
+    stats.current = {};
+    {
+        std::lock_guard lock(stats.mutex);
+        stats.last_frame = {};
+    }
+
+    // The next context starts with nothing bound
+    get_bind_cache() = {};
+    current_viewport() = {};
+    debug_labels_enabled() = false;
+    reset_capabilities();
+    auto& driver = get_driver_memory();
+    driver.info = DriverMemoryInfo::None;
+    driver.total_bytes = 0;
+    driver.available_bytes = 0;
+}
+}
+
+EXPORT void mugfx_shutdown()
+{
+    TRACE_FUNCTION();
+    CAPTURE(CaptureCall::Shutdown);
+    if (!get_pool_storage<Shader>()) {
+        log_error("mugfx is not initialized");
+        return;
+    }
+
+    if (render_thread_defers()) {
+        render_thread_defer([](uint8_t*) { shutdown_gl(); });
+        render_thread_stop();
+    } else {
+        shutdown_gl();
+    }
+
+    get_draw_queue() = {};
+    get_deferred_flat() = {};
+    get_pool_storage<Shader>().reset();
+    get_pool_storage<Texture>().reset();
+    get_pool_storage<Material>().reset();
+    get_pool_storage<Buffer>().reset();
+    get_pool_storage<UniformData>().reset();
+    get_pool_storage<Geometry>().reset();
+    get_pool_storage<DrawPacket>().reset();
+    get_pool_storage<BindingSet>().reset();
+    get_pool_storage<CommandList>().reset();
+    common_shutdown();
+}
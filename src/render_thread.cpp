@@ -0,0 +1,304 @@
+#include "render_thread.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "shared.hpp"
+#include "trace.hpp"
+
+namespace {
+constexpr size_t align16(size_t v)
+{
+    return (v + 15) & ~size_t(15);
+}
+
+// Small enough to fit into any gap at the end of the ring, because commands are aligned to 16 bytes
+struct CommandHeader {
+    DeferredInvoke invoke; // nullptr for padding at the end of the ring
+    uint32_t size; // of the whole command, including the header
+    uint16_t data_offset;
+    uint16_t heap_data; // if true, a HeapData is stored at data_offset
+};
+static_assert(sizeof(CommandHeader) == 16);
+
+// Data that does not fit into the ring is allocated separately
+struct HeapData {
+    uint8_t* data;
+    size_t size;
+};
+
+constexpr size_t FuncOffset = sizeof(CommandHeader);
+constexpr size_t MinCapacity = 64 * 1024;
+
+// Positions are monotonically increasing and only wrapped when indexing into the buffer.
+// Every command is contiguous in memory. If it does not fit before the end of the buffer, the rest
+// is skipped with a padding command.
+class CommandRing {
+public:
+    void init(size_t capacity)
+    {
+        // Every command has to fit into half of the ring
+        capacity_ = align16(std::max(capacity, MinCapacity));
+        data_ = reinterpret_cast<uint8_t*>(allocate(capacity_, MUGFX_ALLOCATION_TAG_STAGING));
+    }
+
+    ~CommandRing() { free(); }
+
+    // Must only be called while nobody reads or writes
+    void free()
+    {
+        if (data_) {
+            deallocate(data_, capacity_, MUGFX_ALLOCATION_TAG_STAGING);
+        }
+        data_ = nullptr;
+        capacity_ = 0;
+        write_pos_ = 0;
+        read_pos_ = 0;
+    }
+
+    size_t capacity() const { return capacity_; }
+
+    // Blocks until `size` contiguous bytes are free
+    uint8_t* begin_write(size_t size)
+    {
+        assert(size % 16 == 0 && size <= capacity_ / 2);
+        const auto write = write_pos_.load(std::memory_order_relaxed);
+        const auto to_end = capacity_ - write % capacity_;
+        const auto needed = size <= to_end ? size : to_end + size;
+        auto read = read_pos_.load(std::memory_order_acquire);
+        while (capacity_ - (write - read) < needed) {
+            read_pos_.wait(read, std::memory_order_acquire);
+            read = read_pos_.load(std::memory_order_acquire);
+        }
+
+        if (size > to_end) {
+            new (data_ + write % capacity_)
+                CommandHeader { nullptr, uint32_t(to_end), 0, false };
+            end_write(to_end);
+        }
+        return data_ + write_pos_.load(std::memory_order_relaxed) % capacity_;
+    }
+
+    void end_write(size_t size)
+    {
+        const auto write = write_pos_.load(std::memory_order_relaxed);
+        write_pos_.store(write + size, std::memory_order_release);
+        write_pos_.notify_one();
+    }
+
+    // Blocks until a command is available
+    CommandHeader* begin_read()
+    {
+        const auto read = read_pos_.load(std::memory_order_relaxed);
+        auto write = write_pos_.load(std::memory_order_acquire);
+        while (write == read) {
+            write_pos_.wait(write, std::memory_order_acquire);
+            write = write_pos_.load(std::memory_order_acquire);
+        }
+        return reinterpret_cast<CommandHeader*>(data_ + read % capacity_);
+    }
+
+    void end_read(size_t size)
+    {
+        const auto read = read_pos_.load(std::memory_order_relaxed);
+        read_pos_.store(read + size, std::memory_order_release);
+        read_pos_.notify_one();
+    }
+
+private:
+    uint8_t* data_ = nullptr;
+    size_t capacity_ = 0;
+    alignas(64) std::atomic<size_t> write_pos_ = 0;
+    alignas(64) std::atomic<size_t> read_pos_ = 0;
+};
+
+struct RenderThread {
+    mugfx_render_thread_params params;
+    CommandRing ring;
+    std::thread thread;
+    bool active = false;
+    bool quit = false; // only accessed on the render thread
+    uint64_t frames_submitted = 0; // only accessed on the game thread
+    std::atomic<uint64_t> frames_completed = 0;
+    uint64_t syncs_submitted = 0; // only accessed on the game thread
+    std::atomic<uint64_t> syncs_completed = 0;
+
+    ~RenderThread();
+};
+
+RenderThread& get_render_thread()
+{
+    static RenderThread render_thread;
+    return render_thread;
+}
+
+thread_local bool on_render_thread = false;
+
+void wait_until(std::atomic<uint64_t>& counter, uint64_t value)
+{
+    auto current = counter.load(std::memory_order_acquire);
+    while (current < value) {
+        counter.wait(current, std::memory_order_acquire);
+        current = counter.load(std::memory_order_acquire);
+    }
+}
+
+void complete(std::atomic<uint64_t>& counter, uint64_t value)
+{
+    counter.store(value, std::memory_order_release);
+    counter.notify_all();
+}
+
+void stop(RenderThread& rt)
+{
+    if (rt.thread.joinable()) {
+        // Everything that was recorded is still executed
+        render_thread_defer([](uint8_t*) { get_render_thread().quit = true; });
+        rt.thread.join();
+    }
+}
+
+RenderThread::~RenderThread()
+{
+    stop(*this);
+}
+
+void render_thread_main()
+{
+    auto& rt = get_render_thread();
+    on_render_thread = true;
+    rt.params.make_current(rt.params.ctx);
+
+    while (!rt.quit) {
+        const auto cmd = rt.ring.begin_read();
+        const auto size = cmd->size;
+        if (cmd->invoke) {
+            const auto base = reinterpret_cast<uint8_t*>(cmd);
+            const auto data = base + cmd->data_offset;
+            if (cmd->heap_data) {
+                const auto heap = *reinterpret_cast<HeapData*>(data);
+                cmd->invoke(base + FuncOffset, heap.data);
+                deallocate(heap.data, heap.size, MUGFX_ALLOCATION_TAG_STAGING);
+            } else {
+                cmd->invoke(base + FuncOffset, data);
+            }
+        }
+        rt.ring.end_read(size);
+    }
+}
+}
+
+size_t DeferredData::add(const void* data, size_t size)
+{
+    if (!data) {
+        return Null;
+    }
+    assert(num_blobs_ < blobs_.size());
+    const auto offset = size_;
+    blobs_[num_blobs_++] = { data, size, offset };
+    // Align every blob, so it can hold any struct
+    size_ = align16(size_ + size);
+    return offset;
+}
+
+size_t DeferredData::add(const char* str)
+{
+    return str ? add(str, std::strlen(str) + 1) : Null;
+}
+
+void DeferredData::copy_to(uint8_t* dst) const
+{
+    for (size_t i = 0; i < num_blobs_; ++i) {
+        std::memcpy(dst + blobs_[i].offset, blobs_[i].data, blobs_[i].size);
+    }
+}
+
+void render_thread_start(const mugfx_render_thread_params& params)
+{
+    auto& rt = get_render_thread();
+    assert(!rt.active);
+    assert(params.make_current);
+    rt.params = params;
+    rt.ring.init(params.command_buffer_size);
+    rt.active = true;
+    rt.thread = std::thread(render_thread_main);
+}
+
+void render_thread_stop()
+{
+    auto& rt = get_render_thread();
+    if (!rt.active) {
+        return;
+    }
+    stop(rt);
+    rt.ring.free();
+    rt.active = false;
+    rt.quit = false;
+    rt.frames_submitted = 0;
+    rt.frames_completed = 0;
+    rt.syncs_submitted = 0;
+    rt.syncs_completed = 0;
+}
+
+bool render_thread_defers()
+{
+    return !on_render_thread && get_render_thread().active;
+}
+
+bool is_render_thread()
+{
+    return on_render_thread;
+}
+
+void render_thread_push(
+    DeferredInvoke invoke, const void* func, size_t func_size, const DeferredData& data)
+{
+    auto& rt = get_render_thread();
+    const auto data_offset = align16(FuncOffset + func_size);
+    // Large uploads would stall the ring (or not fit at all), so they get their own allocation
+    const auto inline_data = data.size() <= rt.ring.capacity() / 8;
+    const auto size = align16(data_offset + (inline_data ? data.size() : sizeof(HeapData)));
+    assert(data_offset <= UINT16_MAX);
+
+    const auto cmd = rt.ring.begin_write(size);
+    new (cmd) CommandHeader { invoke, uint32_t(size), uint16_t(data_offset), !inline_data };
+    std::memcpy(cmd + FuncOffset, func, func_size);
+    if (inline_data) {
+        data.copy_to(cmd + data_offset);
+    } else {
+        const auto heap_data = allocate(data.size(), MUGFX_ALLOCATION_TAG_STAGING);
+        const HeapData heap { reinterpret_cast<uint8_t*>(heap_data), data.size() };
+        data.copy_to(heap.data);
+        new (cmd + data_offset) HeapData { heap };
+    }
+    rt.ring.end_write(size);
+}
+
+void render_thread_end_frame()
+{
+    auto& rt = get_render_thread();
+    const auto frame = ++rt.frames_submitted;
+    render_thread_defer([frame](uint8_t*) {
+        auto& rt = get_render_thread();
+        mugfx_end_frame();
+        if (rt.params.present) {
+            rt.params.present(rt.params.ctx);
+        }
+        complete(rt.frames_completed, frame);
+    });
+    // The render thread may only work on a single frame, while the game thread records the next
+    wait_until(rt.frames_completed, frame - 1);
+}
+
+EXPORT void mugfx_sync()
+{
+    TRACE_FUNCTION();
+    if (!render_thread_defers()) {
+        return;
+    }
+    auto& rt = get_render_thread();
+    const auto sync = ++rt.syncs_submitted;
+    render_thread_defer([sync](uint8_t*) { complete(get_render_thread().syncs_completed, sync); });
+    wait_until(rt.syncs_completed, sync);
+}
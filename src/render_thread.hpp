@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <type_traits>
+
+#include "mugfx.h"
+
+// In render thread mode, the public functions called on the game thread record a deferred call
+// into a lock-free single-producer single-consumer ring buffer, which the render thread executes.
+
+// Collects the memory a deferred call references, which has to be copied, because the caller may
+// free it as soon as the call returns.
+class DeferredData {
+public:
+    static constexpr size_t Null = SIZE_MAX;
+
+    // Returns the offset of the copy relative to the data pointer passed to the deferred call
+    size_t add(const void* data, size_t size);
+    // Includes the null-terminator. Returns Null for nullptr
+    size_t add(const char* str);
+
+    size_t size() const { return size_; }
+    void copy_to(uint8_t* dst) const;
+
+private:
+    struct Blob {
+        const void* data;
+        size_t size;
+        size_t offset;
+    };
+
+    std::array<Blob, 24> blobs_;
+    size_t num_blobs_ = 0;
+    size_t size_ = 0;
+};
+
+template <typename T>
+T* deferred_data(uint8_t* data, size_t offset)
+{
+    return offset == DeferredData::Null ? nullptr : reinterpret_cast<T*>(data + offset);
+}
+
+using DeferredInvoke = void (*)(void* func, uint8_t* data);
+
+void render_thread_start(const mugfx_render_thread_params& params);
+// Executes everything that was recorded and joins the render thread
+void render_thread_stop();
+// True if the calling thread has to defer graphics API calls to the render thread
+bool render_thread_defers();
+bool is_render_thread();
+void render_thread_push(
+    DeferredInvoke invoke, const void* func, size_t func_size, const DeferredData& data);
+// Records mugfx_end_frame and the present callback and waits for the previous frame to finish
+void render_thread_end_frame();
+
+// `func` is copied into the ring buffer and called with a pointer to the copied data on the render
+// thread. It must not own anything, because it is never destroyed.
+template <typename Func>
+void render_thread_defer(const DeferredData& data, Func func)
+{
+    static_assert(std::is_trivially_copyable_v<Func> && std::is_trivially_destructible_v<Func>);
+    static_assert(alignof(Func) <= 16);
+    render_thread_push([](void* f, uint8_t* d) { (*reinterpret_cast<Func*>(f))(d); }, &func,
+        sizeof(Func), data);
+}
+
+template <typename Func>
+void render_thread_defer(Func func)
+{
+    render_thread_defer(DeferredData {}, func);
+}
@@ -1,7 +1,18 @@
 #include "shared.hpp"
 
 #include <array>
+#include <atomic>
 #include <cstdio>
+#include <mutex>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+#include "capture.hpp"
 
 const char* mugfx_severity_to_string(mugfx_severity severity)
 {
@@ -32,6 +43,36 @@ mugfx_panic_handler& get_panic_handler()
     return handler;
 }
 
+mugfx_severity& get_min_log_severity()
+{
+    static mugfx_severity severity = MUGFX_SEVERITY_DEBUG;
+    return severity;
+}
+
+constexpr size_t LogMessageSize = 1024;
+
+// A bounded multi-producer multi-consumer queue (Dmitry Vyukov's). The sequence number of a slot
+// tells producers whether it is free and consumers whether it holds a complete message.
+struct LogQueue {
+    struct Slot {
+        std::atomic<size_t> sequence;
+        mugfx_severity severity;
+        std::array<char, LogMessageSize> message;
+    };
+
+    Slot* slots = nullptr;
+    size_t size = 0;
+    std::atomic<size_t> enqueue_pos = 0;
+    std::atomic<size_t> dequeue_pos = 0;
+    std::atomic<size_t> dropped = 0;
+};
+
+LogQueue& get_log_queue()
+{
+    static LogQueue queue;
+    return queue;
+}
+
 void* default_allocate(size_t size, void*)
 {
     return std::malloc(size);
@@ -54,6 +95,9 @@ mugfx_allocator* get_default_allocator()
         .reallocate = default_reallocate,
         .deallocate = default_deallocate,
         .ctx = nullptr,
+        .allocate_tagged = nullptr,
+        .reallocate_tagged = nullptr,
+        .deallocate_tagged = nullptr,
     };
     return &allocator;
 }
@@ -64,6 +108,56 @@ mugfx_allocator*& get_allocator()
     return allocator;
 }
 
+// Only true if all three tagged functions are set, so allocations are never freed by a different
+// set of functions than the one that allocated them
+bool& get_use_tagged_allocator()
+{
+    static bool use_tagged = false;
+    return use_tagged;
+}
+
+struct AllocationCounters {
+    std::atomic<size_t> count = 0;
+    std::atomic<size_t> bytes = 0;
+    std::atomic<size_t> peak_bytes = 0;
+};
+
+// The last one counts all tags
+std::array<AllocationCounters, MUGFX_ALLOCATION_TAG_COUNT + 1> allocation_counters;
+
+void add_bytes(AllocationCounters& counters, size_t old_size, size_t new_size)
+{
+    const auto delta = new_size - old_size; // wraps around when shrinking, which cancels out
+    const auto bytes = counters.bytes.fetch_add(delta, std::memory_order_relaxed) + delta;
+    auto peak = counters.peak_bytes.load(std::memory_order_relaxed);
+    while (bytes > peak
+        && !counters.peak_bytes.compare_exchange_weak(peak, bytes, std::memory_order_relaxed)) { }
+}
+
+// A size of 0 means there is no allocation
+void count_allocation(mugfx_allocation_tag tag, size_t old_size, size_t new_size)
+{
+    assert(tag >= 0 && tag < MUGFX_ALLOCATION_TAG_COUNT);
+    for (auto& counters : { &allocation_counters[tag], &allocation_counters.back() }) {
+        add_bytes(*counters, old_size, new_size);
+        if (old_size == 0) {
+            counters->count.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (new_size == 0) {
+            counters->count.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+mugfx_allocation_stats load_allocation_stats(const AllocationCounters& counters)
+{
+    return {
+        .count = counters.count.load(std::memory_order_relaxed),
+        .bytes = counters.bytes.load(std::memory_order_relaxed),
+        .peak_bytes = counters.peak_bytes.load(std::memory_order_relaxed),
+    };
+}
+
 template <typename T, typename U>
 void set_default(T& v, U default_value)
 {
@@ -73,44 +167,316 @@ void set_default(T& v, U default_value)
 }
 }
 
-void* allocate(size_t size)
+void* allocate(size_t size, mugfx_allocation_tag tag)
+{
+    const auto allocator = get_allocator();
+    assert(allocator);
+    const auto ptr = get_use_tagged_allocator()
+        ? allocator->allocate_tagged(size, tag, allocator->ctx)
+        : allocator->allocate(size, allocator->ctx);
+    if (ptr) {
+        count_allocation(tag, 0, size);
+    }
+    return ptr;
+}
+
+void* reallocate(void* ptr, size_t old_size, size_t new_size, mugfx_allocation_tag tag)
+{
+    const auto allocator = get_allocator();
+    assert(allocator);
+    const auto new_ptr = get_use_tagged_allocator()
+        ? allocator->reallocate_tagged(ptr, old_size, new_size, tag, allocator->ctx)
+        : allocator->reallocate(ptr, old_size, new_size, allocator->ctx);
+    // A failed reallocation leaves the old allocation untouched
+    if (new_ptr || new_size == 0) {
+        count_allocation(tag, old_size, new_size);
+    }
+    return new_ptr;
+}
+
+void deallocate(void* ptr, size_t size, mugfx_allocation_tag tag)
+{
+    const auto allocator = get_allocator();
+    assert(allocator);
+    count_allocation(tag, size, 0);
+    if (get_use_tagged_allocator()) {
+        allocator->deallocate_tagged(ptr, size, tag, allocator->ctx);
+        return;
+    }
+    allocator->deallocate(ptr, size, allocator->ctx);
+}
+
+namespace {
+#if defined(__unix__) || defined(__APPLE__)
+size_t get_page_size()
+{
+    static const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return page_size;
+}
+
+void* reserve_pages(size_t size)
+{
+    const auto flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+    const auto ptr = mmap(nullptr, size, PROT_NONE, flags, -1, 0);
+    return ptr == MAP_FAILED ? nullptr : ptr;
+}
+
+bool commit_pages(void* ptr, size_t size)
+{
+    return mprotect(ptr, size, PROT_READ | PROT_WRITE) == 0;
+}
+
+void release_pages(void* ptr, size_t size)
+{
+    munmap(ptr, size);
+}
+#elif defined(_WIN32)
+size_t get_page_size()
+{
+    static const auto page_size = [] {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return static_cast<size_t>(info.dwPageSize);
+    }();
+    return page_size;
+}
+
+void* reserve_pages(size_t size)
+{
+    return VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+bool commit_pages(void* ptr, size_t size)
+{
+    return VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+}
+
+void release_pages(void* ptr, size_t)
+{
+    VirtualFree(ptr, 0, MEM_RELEASE);
+}
+#else
+size_t get_page_size()
+{
+    return 4096;
+}
+
+void* reserve_pages(size_t)
+{
+    return nullptr;
+}
+
+bool commit_pages(void*, size_t)
+{
+    return false;
+}
+
+void release_pages(void*, size_t) { }
+#endif
+
+// Committing in larger steps saves system calls. Pages are only backed by physical memory when
+// they are touched anyway.
+constexpr size_t MinCommitSize = 64 * 1024;
+
+size_t round_up(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+}
+
+ReservedMemory::ReservedMemory(size_t size, mugfx_allocation_tag tag)
+    : size_(round_up(size, get_page_size()))
+    , tag_(tag)
+{
+    // The application wants all memory to come from its allocator
+    if (get_allocator() == get_default_allocator()) {
+        data_ = reserve_pages(size_);
+        virtual_ = data_ != nullptr;
+    }
+    if (!virtual_) {
+        data_ = allocate(size_, tag_);
+        committed_ = size_;
+    }
+}
+
+ReservedMemory::~ReservedMemory()
+{
+    if (virtual_) {
+        release_pages(data_, size_);
+    }
+    if (const auto committed = committed_.load(std::memory_order_relaxed)) {
+        if (virtual_) {
+            count_allocation(tag_, committed, 0);
+        } else {
+            deallocate(data_, committed, tag_);
+        }
+    }
+}
+
+bool ReservedMemory::grow(size_t size)
+{
+    assert(virtual_ && size <= size_);
+    const auto committed = committed_.load(std::memory_order_relaxed);
+    const auto new_committed = std::min(
+        round_up(std::max(size, committed + MinCommitSize), get_page_size()), size_);
+    if (!commit_pages(reinterpret_cast<uint8_t*>(data_) + committed, new_committed - committed)) {
+        log_error("Could not commit %zu bytes of memory", new_committed - committed);
+        return false;
+    }
+    count_allocation(tag_, committed, new_committed);
+    committed_.store(new_committed, std::memory_order_relaxed);
+    return true;
+}
+
+mugfx_allocation_stats get_allocation_stats()
+{
+    return load_allocation_stats(allocation_counters.back());
+}
+
+mugfx_allocation_stats get_allocation_stats(mugfx_allocation_tag tag)
+{
+    assert(tag >= 0 && tag < MUGFX_ALLOCATION_TAG_COUNT);
+    return load_allocation_stats(allocation_counters[tag]);
+}
+
+namespace {
+void init_log_queue(size_t size)
+{
+    auto& queue = get_log_queue();
+    if (queue.slots) {
+        const auto bytes = sizeof(LogQueue::Slot) * queue.size;
+        deallocate(queue.slots, bytes, MUGFX_ALLOCATION_TAG_INTERNAL);
+    }
+    queue.slots = nullptr;
+    queue.size = size;
+    queue.enqueue_pos = 0;
+    queue.dequeue_pos = 0;
+    queue.dropped = 0;
+    if (size > 0) {
+        queue.slots = reinterpret_cast<LogQueue::Slot*>(
+            allocate(sizeof(LogQueue::Slot) * size, MUGFX_ALLOCATION_TAG_INTERNAL));
+        for (size_t i = 0; i < size; ++i) {
+            new (&queue.slots[i].sequence) std::atomic<size_t>(i);
+        }
+    }
+}
+
+bool log_enabled(mugfx_severity severity)
+{
+    if (severity > MUGFX_SEVERITY_ERROR && get_panic_handler()) {
+        return true;
+    }
+    return severity >= get_min_log_severity() && get_logging_callback();
+}
+
+bool log_queued(mugfx_severity severity)
 {
-    assert(get_allocator());
-    return get_allocator()->allocate(size, get_allocator()->ctx);
+    // Panics can't wait
+    return get_log_queue().size > 0 && severity <= MUGFX_SEVERITY_ERROR;
 }
 
-void* reallocate(void* ptr, size_t old_size, size_t new_size)
+// `write` formats the message into the buffer it is passed
+template <typename Func>
+void enqueue_log(mugfx_severity severity, Func write)
 {
-    assert(get_allocator());
-    return get_allocator()->reallocate(ptr, old_size, new_size, get_allocator()->ctx);
+    auto& queue = get_log_queue();
+    auto pos = queue.enqueue_pos.load(std::memory_order_relaxed);
+    while (true) {
+        auto& slot = queue.slots[pos % queue.size];
+        const auto sequence = slot.sequence.load(std::memory_order_acquire);
+        const auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (queue.enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                slot.severity = severity;
+                write(slot.message.data(), slot.message.size());
+                slot.sequence.store(pos + 1, std::memory_order_release);
+                return;
+            }
+        } else if (diff < 0) {
+            queue.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            pos = queue.enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
 }
 
-void deallocate(void* ptr, size_t size)
+bool dequeue_log(mugfx_logging_callback callback)
 {
-    assert(get_allocator());
-    get_allocator()->deallocate(ptr, size, get_allocator()->ctx);
+    auto& queue = get_log_queue();
+    auto pos = queue.dequeue_pos.load(std::memory_order_relaxed);
+    while (true) {
+        auto& slot = queue.slots[pos % queue.size];
+        const auto sequence = slot.sequence.load(std::memory_order_acquire);
+        const auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+        if (diff == 0) {
+            if (queue.dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                callback(slot.severity, slot.message.data());
+                slot.sequence.store(pos + queue.size, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false; // empty, or the next message is still being written
+        } else {
+            pos = queue.dequeue_pos.load(std::memory_order_relaxed);
+        }
+    }
+}
 }
 
 void log(mugfx_severity severity, const char* msg)
 {
+    if (!log_enabled(severity)) {
+        return;
+    }
     const auto panic_handler = get_panic_handler();
     if (severity > MUGFX_SEVERITY_ERROR && panic_handler) {
         panic_handler(msg);
         std::abort();
     }
-    const auto logging_callback = get_logging_callback();
-    if (logging_callback) {
-        logging_callback(severity, msg);
+    if (log_queued(severity)) {
+        enqueue_log(
+            severity, [msg](char* buf, size_t size) { std::snprintf(buf, size, "%s", msg); });
+        return;
     }
+    get_logging_callback()(severity, msg);
 }
 
 void log_fmt(mugfx_severity severity, const char* fmt, std::va_list va)
 {
-    static std::array<char, 1024> buf;
+    // Checked first, so filtered messages cost no formatting
+    if (!log_enabled(severity)) {
+        return;
+    }
+    if (log_queued(severity)) {
+        enqueue_log(severity, [&](char* buf, size_t size) { std::vsnprintf(buf, size, fmt, va); });
+        return;
+    }
+    thread_local std::array<char, LogMessageSize> buf;
     std::vsnprintf(buf.data(), buf.size(), fmt, va);
     log(severity, buf.data());
 }
 
+EXPORT size_t mugfx_log_drain()
+{
+    auto& queue = get_log_queue();
+    const auto callback = get_logging_callback();
+    if (queue.size == 0 || !callback) {
+        return 0;
+    }
+    size_t count = 0;
+    while (dequeue_log(callback)) {
+        ++count;
+    }
+    if (const auto dropped = queue.dropped.exchange(0, std::memory_order_relaxed)) {
+        std::array<char, 128> buf;
+        std::snprintf(buf.data(), buf.size(),
+            "%zu log messages were dropped, because the queue was full", dropped);
+        callback(MUGFX_SEVERITY_WARN, buf.data());
+    }
+    return count;
+}
+
 void log_debug(const char* fmt, ...)
 {
     va_list args;
@@ -143,12 +509,239 @@ void log_error(const char* fmt, ...)
     va_end(args);
 }
 
+namespace {
+struct AtomEntry {
+    const char* str;
+    uint32_t size;
+    uint32_t hash;
+};
+
+struct AtomChunk {
+    char* data;
+    size_t size;
+};
+
+// Strings are stored in chunks and entries in pages, neither of which are ever moved, so atoms can
+// be resolved without a lock. Only interning locks the mutex.
+struct AtomTable {
+    static constexpr size_t ChunkSize = 4096;
+    static constexpr size_t PageSize = 1024;
+    static constexpr size_t MaxPages = 1024;
+
+    std::mutex mutex;
+    Vector<AtomChunk, MUGFX_ALLOCATION_TAG_STRING> chunks;
+    size_t chunk_used = 0;
+    // Open addressing with linear probing, 0 is an empty slot. The size is a power of two.
+    uint32_t* slots = nullptr;
+    size_t num_slots = 0;
+    size_t num_atoms = 0;
+    std::array<AtomEntry*, MaxPages> pages = {}; // atom - 1 is the index into all pages
+};
+
+// Only a pointer, so nothing is left to destruct (with an allocator that may be gone) at exit
+AtomTable*& get_atom_table()
+{
+    static AtomTable* table = nullptr;
+    return table;
+}
+
+std::mutex& get_atom_table_mutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+const AtomEntry& get_atom_entry(const AtomTable& table, Atom atom)
+{
+    assert(atom > 0 && atom <= table.num_atoms);
+    const auto idx = atom - 1;
+    return table.pages[idx / AtomTable::PageSize][idx % AtomTable::PageSize];
+}
+
+// Returns the slot that contains the atom for `str` or the empty slot where it would be inserted
+size_t find_slot(const AtomTable& table, std::string_view str, uint32_t hash)
+{
+    const auto mask = table.num_slots - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        const auto atom = table.slots[i];
+        if (!atom) {
+            return i;
+        }
+        const auto& entry = get_atom_entry(table, atom);
+        if (entry.hash == hash && std::string_view(entry.str, entry.size) == str) {
+            return i;
+        }
+    }
+}
+
+void grow_slots(AtomTable& table)
+{
+    const auto num_slots = table.num_slots ? 2 * table.num_slots : 256;
+    const auto slots_size = sizeof(uint32_t) * num_slots;
+    auto slots = reinterpret_cast<uint32_t*>(allocate(slots_size, MUGFX_ALLOCATION_TAG_STRING));
+    std::memset(slots, 0, slots_size);
+    const auto mask = num_slots - 1;
+    for (size_t a = 1; a <= table.num_atoms; ++a) {
+        size_t i = get_atom_entry(table, static_cast<Atom>(a)).hash & mask;
+        while (slots[i]) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = static_cast<Atom>(a);
+    }
+    if (table.slots) {
+        deallocate(table.slots, sizeof(uint32_t) * table.num_slots, MUGFX_ALLOCATION_TAG_STRING);
+    }
+    table.slots = slots;
+    table.num_slots = num_slots;
+}
+
+const char* store_string(AtomTable& table, std::string_view str)
+{
+    const auto size = str.size() + 1; // null-terminator
+    if (table.chunks.empty() || table.chunk_used + size > table.chunks.back().size) {
+        const auto chunk_size = std::max(size, AtomTable::ChunkSize);
+        auto data = reinterpret_cast<char*>(allocate(chunk_size, MUGFX_ALLOCATION_TAG_STRING));
+        table.chunks.push_back({ data, chunk_size });
+        table.chunk_used = 0;
+    }
+    auto dst = table.chunks.back().data + table.chunk_used;
+    std::memcpy(dst, str.data(), str.size());
+    dst[str.size()] = '\0';
+    table.chunk_used += size;
+    return dst;
+}
+}
+
+// FNV-1a
+uint32_t hash_string(std::string_view str)
+{
+    uint32_t hash = 2166136261u;
+    for (const auto c : str) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    return hash;
+}
+
+Atom intern(std::string_view str)
+{
+    if (str.empty()) {
+        return 0;
+    }
+    std::lock_guard lock(get_atom_table_mutex());
+    auto& table_ptr = get_atom_table();
+    if (!table_ptr) {
+        table_ptr = new (allocate(sizeof(AtomTable), MUGFX_ALLOCATION_TAG_STRING)) AtomTable;
+    }
+    auto& table = *table_ptr;
+    // Keep the load factor below 1/2
+    if (2 * (table.num_atoms + 1) > table.num_slots) {
+        grow_slots(table);
+    }
+    const auto hash = hash_string(str);
+    const auto slot = find_slot(table, str, hash);
+    if (table.slots[slot]) {
+        return table.slots[slot];
+    }
+
+    const auto idx = table.num_atoms;
+    const auto page = idx / AtomTable::PageSize;
+    if (page >= AtomTable::MaxPages) {
+        log_error("Maximum number of interned strings reached");
+        return 0;
+    }
+    if (!table.pages[page]) {
+        table.pages[page] = reinterpret_cast<AtomEntry*>(allocate(
+            sizeof(AtomEntry) * AtomTable::PageSize, MUGFX_ALLOCATION_TAG_STRING));
+    }
+    const auto str_copy = store_string(table, str);
+    table.pages[page][idx % AtomTable::PageSize]
+        = { str_copy, static_cast<uint32_t>(str.size()), hash };
+    table.num_atoms++;
+    const auto atom = static_cast<Atom>(table.num_atoms);
+    table.slots[slot] = atom;
+    return atom;
+}
+
+// Whoever has an atom got it from intern (through some synchronization, if it was on another
+// thread), so its entry and everything before it is visible without locking.
+std::string_view atom_view(Atom atom)
+{
+    if (!atom) {
+        return {};
+    }
+    const auto& entry = get_atom_entry(*get_atom_table(), atom);
+    return std::string_view(entry.str, entry.size);
+}
+
+const char* atom_str(Atom atom)
+{
+    return atom ? atom_view(atom).data() : "";
+}
+
+void free_atoms()
+{
+    std::lock_guard lock(get_atom_table_mutex());
+    auto& table = get_atom_table();
+    if (!table) {
+        return;
+    }
+    for (const auto& chunk : table->chunks) {
+        deallocate(chunk.data, chunk.size, MUGFX_ALLOCATION_TAG_STRING);
+    }
+    for (const auto page : table->pages) {
+        if (page) {
+            deallocate(
+                page, sizeof(AtomEntry) * AtomTable::PageSize, MUGFX_ALLOCATION_TAG_STRING);
+        }
+    }
+    if (table->slots) {
+        deallocate(table->slots, sizeof(uint32_t) * table->num_slots, MUGFX_ALLOCATION_TAG_STRING);
+    }
+    table->~AtomTable();
+    deallocate(table, sizeof(AtomTable), MUGFX_ALLOCATION_TAG_STRING);
+    table = nullptr;
+}
+
+size_t get_uniform_index(
+    const std::array<UniformMetadata, MUGFX_MAX_UNIFORMS>& metadata, const char* name)
+{
+    // Only the name whose hash matches (almost always the right one) is compared as a string
+    const auto view = std::string_view(name);
+    const auto hash = hash_string(view);
+    for (size_t i = 0; i < MUGFX_MAX_UNIFORMS && metadata[i].type; ++i) {
+        if (metadata[i].name && metadata[i].name_hash == hash
+            && atom_view(metadata[i].name) == view) {
+            return i;
+        }
+    }
+    return MUGFX_MAX_UNIFORMS;
+}
+
 void common_init(mugfx_init_params& params)
 {
     default_init(params);
     get_logging_callback() = params.logging_callback;
     get_panic_handler() = params.panic_handler;
+    get_min_log_severity() = params.min_log_severity;
     get_allocator() = params.allocator ? params.allocator : get_default_allocator();
+    const auto alloc = get_allocator();
+    const auto num_tagged = (alloc->allocate_tagged != nullptr)
+        + (alloc->reallocate_tagged != nullptr) + (alloc->deallocate_tagged != nullptr);
+    if (num_tagged != 0 && num_tagged != 3) {
+        log_error("Set all or none of the tagged allocator functions, using the untagged ones");
+    }
+    get_use_tagged_allocator() = num_tagged == 3;
+    init_log_queue(params.log_queue_size);
+    capture_begin(params.capture);
+}
+
+void common_shutdown()
+{
+    capture_end();
+    free_atoms();
+    // So nothing that was logged during shutdown is lost
+    mugfx_log_drain();
+    init_log_queue(0);
 }
 
 void default_init(mugfx_init_params& params)
@@ -156,6 +749,7 @@ void default_init(mugfx_init_params& params)
     if (!params.allocator) {
         params.allocator = get_default_allocator();
     }
+    set_default(params.min_log_severity, MUGFX_SEVERITY_DEBUG);
     set_default(params.max_num_shaders, 64);
     set_default(params.max_num_textures, 128);
     set_default(params.max_num_uniforms, 1024);
@@ -164,6 +758,16 @@ void default_init(mugfx_init_params& params)
     set_default(params.max_num_geometries, 1024);
     set_default(params.max_num_render_targets, 32);
     set_default(params.max_num_pipelines, 1024);
+    set_default(params.max_num_draw_packets, 1024);
+    set_default(params.max_num_binding_sets, 1024);
+    set_default(params.max_num_command_lists, 64);
+    set_default(params.render_thread.command_buffer_size, 16 * 1024 * 1024);
+    set_default(params.state_change_costs.program, 10.0f);
+    set_default(params.state_change_costs.vao, 4.0f);
+    set_default(params.state_change_costs.texture, 2.0f);
+    set_default(params.state_change_costs.state, 1.5f);
+    set_default(params.state_change_costs.uniforms, 1.0f);
+    set_default(params.capture.chunk_size, 1024 * 1024);
 }
 
 void default_init(mugfx_shader_create_params&) { }
@@ -206,4 +810,60 @@ void default_init(mugfx_render_target_create_params& params)
 {
     set_default(params.color_formats[0], MUGFX_PIXEL_FORMAT_RGBA8);
     set_default(params.depth_format, MUGFX_PIXEL_FORMAT_DEPTH24);
-}
\ No newline at end of file
+}
+
+void default_init(mugfx_command_list_create_params& params)
+{
+    set_default(params.max_num_draws, 1024);
+    set_default(params.max_num_bindings, 4 * params.max_num_draws);
+}
+
+void default_init(mugfx_draw_command& command)
+{
+    set_default(command.instance_count, 1);
+}
+
+void default_init(mugfx_overdraw_params& params)
+{
+    set_default(params.max_overdraw, 8);
+}
+
+#ifdef MUGFX_FRAME_STATS
+mugfx_frame_stats current_frame_stats = {};
+#endif
+
+namespace {
+struct LastFrameStats {
+    std::mutex mutex; // read from the game thread in render thread mode
+    mugfx_frame_stats stats = {};
+};
+
+LastFrameStats& get_last_frame_stats()
+{
+    static LastFrameStats last;
+    return last;
+}
+}
+
+void begin_frame_stats()
+{
+#ifdef MUGFX_FRAME_STATS
+    current_frame_stats = {};
+#endif
+}
+
+void end_frame_stats()
+{
+#ifdef MUGFX_FRAME_STATS
+    auto& last = get_last_frame_stats();
+    std::lock_guard lock(last.mutex);
+    last.stats = current_frame_stats;
+#endif
+}
+
+EXPORT mugfx_frame_stats mugfx_get_frame_stats()
+{
+    auto& last = get_last_frame_stats();
+    std::lock_guard lock(last.mutex);
+    return last.stats;
+}
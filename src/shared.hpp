@@ -1,19 +1,64 @@
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <cstdarg>
 #include <cstdlib>
 #include <cstring>
+#include <mutex>
 #include <optional>
 #include <string_view>
+#include <type_traits>
 #include <utility>
 
 #include "mugfx.h"
 
 #define EXPORT extern "C"
 
-void* allocate(size_t size);
-void* reallocate(void* ptr, size_t old_size, size_t new_size);
-void deallocate(void* ptr, size_t size);
+void* allocate(size_t size, mugfx_allocation_tag tag);
+void* reallocate(void* ptr, size_t old_size, size_t new_size, mugfx_allocation_tag tag);
+void deallocate(void* ptr, size_t size, mugfx_allocation_tag tag);
+
+// A deleter for std::unique_ptr, for memory returned by allocate
+struct Deallocate {
+    size_t size = 0;
+    mugfx_allocation_tag tag = MUGFX_ALLOCATION_TAG_INTERNAL;
+    void operator()(void* ptr) const { deallocate(ptr, size, tag); }
+};
+
+// Totals over all tags
+mugfx_allocation_stats get_allocation_stats();
+mugfx_allocation_stats get_allocation_stats(mugfx_allocation_tag tag);
+
+// Reserves address space up front and commits memory only as it is used. If virtual memory is not
+// available or the application passed its own allocator, the whole size is allocated right away
+// (with the allocator), which still only commits the pages that are touched with most allocators.
+class ReservedMemory {
+public:
+    ReservedMemory(size_t size, mugfx_allocation_tag tag);
+    ~ReservedMemory();
+
+    ReservedMemory(const ReservedMemory&) = delete;
+    ReservedMemory& operator=(const ReservedMemory&) = delete;
+
+    void* data() const { return data_; }
+    // Makes the first `size` bytes usable. Returns false if the memory could not be committed.
+    bool commit(size_t size)
+    {
+        return size <= committed_.load(std::memory_order_relaxed) || grow(size);
+    }
+    // May be called from any thread
+    size_t committed() const { return committed_.load(std::memory_order_relaxed); }
+
+private:
+    bool grow(size_t size);
+
+    void* data_ = nullptr;
+    size_t size_ = 0;
+    std::atomic<size_t> committed_ = 0;
+    mugfx_allocation_tag tag_;
+    bool virtual_ = false;
+};
 
 #ifdef __GNUC__
 #define PRINTFLIKE(n, m) __attribute__((format(printf, n, m)))
@@ -29,6 +74,7 @@ void log_warn(const char* fmt, ...) PRINTFLIKE(1, 2);
 void log_error(const char* fmt, ...) PRINTFLIKE(1, 2);
 
 void common_init(mugfx_init_params& params);
+void common_shutdown();
 void default_init(mugfx_init_params& params);
 void default_init(mugfx_shader_create_params& params);
 void default_init(mugfx_texture_create_params& params);
@@ -36,54 +82,118 @@ void default_init(mugfx_material_create_params& params);
 void default_init(mugfx_buffer_create_params& params);
 void default_init(mugfx_geometry_create_params& params);
 void default_init(mugfx_render_target_create_params& params);
+void default_init(mugfx_command_list_create_params& params);
+void default_init(mugfx_draw_command& command);
+void default_init(mugfx_overdraw_params& params);
+
+#ifdef MUGFX_FRAME_STATS
+// Only counted on the thread that owns the context
+extern mugfx_frame_stats current_frame_stats;
+#define COUNT_STAT(counter, n) (current_frame_stats.counter += (n))
+#else
+#define COUNT_STAT(counter, n) ((void)0)
+#endif
+
+void begin_frame_stats();
+void end_frame_stats();
 
 template <typename T>
 struct Pool {
     static_assert(sizeof(T) >= sizeof(uint16_t));
 
+    // Slots are only initialized (and their memory committed) when they are used for the first
+    // time, so a pool that is much larger than needed costs little more than address space.
     Pool(size_t size)
-        : data_(reinterpret_cast<T*>(allocate(sizeof(T) * size)))
-        , ids_(reinterpret_cast<Id*>(allocate(sizeof(Id) * size)))
+        : data_memory_(sizeof(T) * size, MUGFX_ALLOCATION_TAG_POOL)
+        , ids_memory_(sizeof(AtomicId) * size, MUGFX_ALLOCATION_TAG_POOL)
+        , data_(reinterpret_cast<T*>(data_memory_.data()))
+        , ids_(reinterpret_cast<AtomicId*>(ids_memory_.data()))
         , size_(size)
+        , free_list_head_(size)
     {
-        assert(size > 0 && size < 0xffff);
-        for (size_t i = 0; i < size; ++i) {
-            store_free_list(i, i + 1);
-            // We invalidate on removal and we want to start with generation 1, so we init with 1
-            new (ids_ + i) Id { EmptyIndex, 1 };
-        }
+        assert(size > 0 && size < ReservedIndex);
     }
 
     ~Pool()
     {
-        for (size_t i = 0; i < size_; ++i) {
-            if (ids_[i].idx != EmptyIndex) {
-                destroy_value(i);
-            } else {
+        for (size_t i = 0; i < used_; ++i) {
+            const auto id = load_id(i);
+            if (id.idx == EmptyIndex) {
                 destroy_free_list(i);
+            } else if (id.idx != ReservedIndex) {
+                destroy_value(i);
             }
-            ids_[i].~Id();
+            ids_[i].~AtomicId();
         }
-        deallocate(data_, sizeof(T) * size_);
-        deallocate(ids_, sizeof(Id) * size_);
     }
 
     uint32_t insert(T&& v)
     {
-        const auto idx = free_list_head_;
-        assert(idx < size_);
-        assert(ids_[idx].idx == EmptyIndex);
-        free_list_head_ = get_free_list(idx);
-        destroy_free_list(idx);
-        store_value(idx, std::move(v));
-        ids_[idx].idx = idx; // mark not empty
-        return ids_[idx].combine();
+        const auto key = reserve();
+        assert(key);
+        if (!key) {
+            return 0;
+        }
+        emplace(key, std::move(v));
+        return key;
+    }
+
+    // Takes a slot from the free list without storing a value in it yet, so the key can be handed
+    // out before the value exists. Returns 0 if the pool is full.
+    // reserve and remove (or cancel) may be called from different threads concurrently.
+    uint32_t reserve()
+    {
+        std::lock_guard lock(free_list_mutex_);
+        auto idx = free_list_head_;
+        if (idx < size_) {
+            assert(load_id(idx).idx == EmptyIndex);
+            free_list_head_ = get_free_list(idx);
+            destroy_free_list(idx);
+        } else {
+            idx = used_.load(std::memory_order_relaxed);
+            if (idx >= size_) {
+                return 0;
+            }
+            if (!data_memory_.commit(sizeof(T) * (idx + 1))
+                || !ids_memory_.commit(sizeof(AtomicId) * (idx + 1))) {
+                return 0;
+            }
+            // We invalidate on removal and we want to start with generation 1, so we init with 1
+            new (ids_ + idx) AtomicId { Id(EmptyIndex, 1).combine() };
+            used_.store(idx + 1, std::memory_order_release);
+        }
+        const auto gen = load_id(idx).gen;
+        store_id(idx, Id(ReservedIndex, gen));
+        high_water_ = std::max(high_water_, ++count_);
+        return Id(idx, gen).combine();
+    }
+
+    // Stores the value for a key returned by reserve
+    void emplace(uint32_t key, T&& v)
+    {
+        const auto id = Id(key);
+        assert(id.idx < size_ && load_id(id.idx).combine() == Id(ReservedIndex, id.gen).combine());
+        store_value(id.idx, std::move(v));
+        store_id(id.idx, id); // mark not empty, publishes the value
+    }
+
+    // Returns a reserved slot that never received a value
+    void cancel(uint32_t key)
+    {
+        const auto id = Id(key);
+        assert(id.idx < size_ && load_id(id.idx).combine() == Id(ReservedIndex, id.gen).combine());
+        release(id.idx);
     }
 
+    // Lookups (contains and get) may happen on any thread, concurrently with insertions and
+    // removals of other keys. A key that was removed concurrently is either found or not, but
+    // never mistaken for another value, because the generation is checked.
     bool contains(uint32_t key)
     {
         const auto id = Id(key);
-        return id.idx < size_ && ids_[id.idx].gen == id.gen;
+        // Occupied slots store their own index
+        return id.idx < used_.load(std::memory_order_acquire)
+            && load_id(id.idx).combine() == id.combine();
     }
 
     bool remove(uint32_t key)
@@ -93,18 +203,44 @@ struct Pool {
         }
         const auto idx = Id(key).idx;
         destroy_value(idx);
-        store_free_list(idx, free_list_head_);
-        free_list_head_ = idx;
-        ids_[idx].idx = EmptyIndex;
+        release(idx);
         return true;
     }
 
     T* get(uint32_t key) { return contains(key) ? data_ + Id(key).idx : nullptr; }
 
+    // Calls `func` with the key of every occupied slot. `func` may remove that key.
+    template <typename Func>
+    void for_each_key(Func func)
+    {
+        for (size_t i = 0; i < used_.load(std::memory_order_acquire); ++i) {
+            const auto id = load_id(i);
+            if (id.idx == i) {
+                func(id.combine());
+            }
+        }
+    }
+
     size_t capacity() const { return size_; }
 
+    // Reserved slots count as occupied
+    size_t size()
+    {
+        std::lock_guard lock(free_list_mutex_);
+        return count_;
+    }
+
+    size_t high_water()
+    {
+        std::lock_guard lock(free_list_mutex_);
+        return high_water_;
+    }
+
+    size_t allocated_bytes() const { return data_memory_.committed() + ids_memory_.committed(); }
+
 private:
     static constexpr size_t EmptyIndex = 0xFFFF;
+    static constexpr size_t ReservedIndex = 0xFFFE;
 
     struct Id {
         uint16_t idx;
@@ -115,16 +251,39 @@ private:
         uint32_t combine() const { return gen << 16 | idx; }
     };
 
+    // Stored combined, so index and generation are read together
+    using AtomicId = std::atomic<uint32_t>;
+
+    Id load_id(size_t idx) const { return Id(ids_[idx].load(std::memory_order_acquire)); }
+    void store_id(size_t idx, Id id) { ids_[idx].store(id.combine(), std::memory_order_release); }
+
     void store_free_list(size_t idx, uint16_t value) { new (data_ + idx) uint16_t { value }; }
     uint16_t get_free_list(size_t idx) const { return *reinterpret_cast<uint16_t*>(data_ + idx); }
     void destroy_free_list(size_t idx) { reinterpret_cast<uint16_t*>(data_ + idx)->~uint16_t(); }
     void store_value(size_t idx, T&& v) { new (data_ + idx) T { std::move(v) }; }
     void destroy_value(size_t idx) { (data_ + idx)->~T(); }
 
+    void release(size_t idx)
+    {
+        std::lock_guard lock(free_list_mutex_);
+        store_free_list(idx, free_list_head_);
+        free_list_head_ = idx;
+        --count_;
+        // Skip generation 0 on wrap-around, so a key is never 0
+        const auto gen = load_id(idx).gen;
+        store_id(idx, Id(EmptyIndex, gen == 0xFFFF ? 1 : gen + 1));
+    }
+
+    ReservedMemory data_memory_;
+    ReservedMemory ids_memory_;
     T* data_;
-    Id* ids_;
+    AtomicId* ids_;
     size_t size_;
-    size_t free_list_head_ = 0;
+    size_t free_list_head_; // size_ if the free list is empty
+    std::atomic<size_t> used_ = 0; // slots below this were initialized
+    size_t count_ = 0;
+    size_t high_water_ = 0;
+    std::mutex free_list_mutex_;
 };
 
 template <size_t Size = 128>
@@ -179,6 +338,134 @@ private:
     size_t size_ = 0;
 };
 
+// Interned strings (resource names). Equal strings are always interned as the same atom, so they
+// can be compared as integers. The intern table only grows and is freed by common_shutdown.
+// Interning takes a lock, resolving an atom does not.
+using Atom = uint32_t; // 0 is the empty string
+
+uint32_t hash_string(std::string_view str);
+Atom intern(std::string_view str);
+std::string_view atom_view(Atom atom);
+// Null-terminated
+const char* atom_str(Atom atom);
+void free_atoms();
+
+struct UniformMetadata {
+    Atom name = 0;
+    uint32_t name_hash = 0; // hash_string of the name, to find uniforms by name quickly
+    mugfx_uniform_type type;
+    size_t array_size = 0;
+    size_t offset = 0;
+};
+
+// Returns MUGFX_MAX_UNIFORMS if there is no uniform with that name
+size_t get_uniform_index(
+    const std::array<UniformMetadata, MUGFX_MAX_UNIFORMS>& metadata, const char* name);
+
+// A growable array for trivially copyable types, that allocates through the mugfx allocator
+template <typename T, mugfx_allocation_tag Tag = MUGFX_ALLOCATION_TAG_INTERNAL>
+class Vector {
+public:
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    Vector() = default;
+
+    Vector(size_t capacity) { reserve(capacity); }
+
+    Vector(Vector&& other)
+        : data_(std::exchange(other.data_, nullptr))
+        , size_(std::exchange(other.size_, 0))
+        , capacity_(std::exchange(other.capacity_, 0))
+    {
+    }
+
+    Vector& operator=(Vector&& other)
+    {
+        if (this != &other) {
+            free();
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+            capacity_ = std::exchange(other.capacity_, 0);
+        }
+        return *this;
+    }
+
+    ~Vector() { free(); }
+
+    void reserve(size_t capacity)
+    {
+        if (capacity <= capacity_) {
+            return;
+        }
+        data_ = reinterpret_cast<T*>(
+            reallocate(data_, sizeof(T) * capacity_, sizeof(T) * capacity, Tag));
+        capacity_ = capacity;
+    }
+
+    void push_back(const T& v)
+    {
+        if (size_ == capacity_) {
+            reserve(capacity_ ? 2 * capacity_ : 16);
+        }
+        data_[size_++] = v;
+    }
+
+    void append(const T* values, size_t count)
+    {
+        if (size_ + count > capacity_) {
+            reserve(std::max(size_ + count, 2 * capacity_));
+        }
+        if (count > 0) {
+            std::memcpy(data_ + size_, values, sizeof(T) * count);
+        }
+        size_ += count;
+    }
+
+    void pop_back()
+    {
+        assert(size_ > 0);
+        --size_;
+    }
+
+    void clear() { size_ = 0; }
+
+    T& operator[](size_t idx)
+    {
+        assert(idx < size_);
+        return data_[idx];
+    }
+
+    const T& operator[](size_t idx) const
+    {
+        assert(idx < size_);
+        return data_[idx];
+    }
+
+    T& back() { return (*this)[size_ - 1]; }
+    const T& back() const { return (*this)[size_ - 1]; }
+    T* data() { return data_; }
+    const T* data() const { return data_; }
+    T* begin() { return data_; }
+    T* end() { return data_ + size_; }
+    const T* begin() const { return data_; }
+    const T* end() const { return data_ + size_; }
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    bool empty() const { return size_ == 0; }
+
+private:
+    void free()
+    {
+        if (data_) {
+            deallocate(data_, sizeof(T) * capacity_, Tag);
+        }
+    }
+
+    T* data_ = nullptr;
+    size_t size_ = 0;
+    size_t capacity_ = 0;
+};
+
 constexpr uint32_t inthash(uint32_t x)
 {
     x ^= x >> 16;
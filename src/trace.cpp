@@ -0,0 +1,186 @@
+#include "trace.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+#include "shared.hpp"
+
+namespace {
+class TraceWriter {
+public:
+    TraceWriter(mugfx_trace_write write, void* ctx) : write_(write), ctx_(ctx) { }
+
+    ~TraceWriter() { flush(); }
+
+    void append(const char* str) { append(str, std::strlen(str)); }
+
+    void append(const char* str, size_t len)
+    {
+        if (size_ + len > buffer_.size()) {
+            flush();
+        }
+        std::memcpy(buffer_.data() + size_, str, len);
+        size_ += len;
+    }
+
+    void flush()
+    {
+        if (size_ > 0) {
+            write_(buffer_.data(), size_, ctx_);
+            size_ = 0;
+        }
+    }
+
+private:
+    mugfx_trace_write write_;
+    void* ctx_;
+    std::array<char, 4096> buffer_;
+    size_t size_ = 0;
+};
+}
+
+#ifdef MUGFX_TRACING
+namespace {
+constexpr size_t TraceRingSize = 1 << 16;
+constexpr size_t MaxTraceThreads = 64;
+
+// The fields are atomic, so the dumping thread may read an event while it is overwritten.
+// Such events are detected with TraceRing::claimed (like a seqlock) and skipped.
+struct TraceEvent {
+    std::atomic<const char*> name;
+    std::atomic<uint64_t> start_ns;
+    std::atomic<uint64_t> duration_ns;
+};
+
+struct TraceRing {
+    uint32_t thread_id;
+    std::atomic<uint64_t> write = 0; // only written by the owning thread
+    // Bumped by the owning thread before it writes an event, so it is ahead of `write` while the
+    // slot of event `write - TraceRingSize` is being overwritten
+    std::atomic<uint64_t> claimed = 0;
+    uint64_t read = 0; // only accessed while dumping
+    TraceEvent* events;
+};
+
+struct TraceRegistry {
+    std::mutex mutex; // taken when a thread records its first event and while dumping
+    std::array<TraceRing*, MaxTraceThreads> rings = {};
+    size_t num_rings = 0;
+};
+
+TraceRegistry& get_trace_registry()
+{
+    static TraceRegistry registry;
+    return registry;
+}
+
+uint64_t now_ns()
+{
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+// Rings are never freed, so events of threads that exited can still be dumped
+TraceRing* get_thread_ring()
+{
+    thread_local TraceRing* ring = nullptr;
+    thread_local bool registered = false;
+    if (registered) {
+        return ring;
+    }
+    registered = true;
+
+    auto& registry = get_trace_registry();
+    std::lock_guard lock(registry.mutex);
+    if (registry.num_rings >= registry.rings.size()) {
+        log_warn("Too many threads for tracing, events of this thread are not recorded");
+        return nullptr;
+    }
+    ring = reinterpret_cast<TraceRing*>(allocate(sizeof(TraceRing), MUGFX_ALLOCATION_TAG_INTERNAL));
+    new (ring) TraceRing {};
+    ring->thread_id = static_cast<uint32_t>(registry.num_rings + 1);
+    ring->events = reinterpret_cast<TraceEvent*>(
+        allocate(sizeof(TraceEvent) * TraceRingSize, MUGFX_ALLOCATION_TAG_INTERNAL));
+    for (size_t i = 0; i < TraceRingSize; ++i) {
+        new (ring->events + i) TraceEvent {};
+    }
+    registry.rings[registry.num_rings++] = ring;
+    return ring;
+}
+}
+
+TraceScope::TraceScope(const char* name) : name_(name), start_(now_ns()) { }
+
+TraceScope::~TraceScope()
+{
+    const auto end = now_ns();
+    const auto ring = get_thread_ring();
+    if (!ring) {
+        return;
+    }
+    const auto idx = ring->write.load(std::memory_order_relaxed);
+    ring->claimed.store(idx + 1, std::memory_order_relaxed);
+    // Orders the claim before the field stores, so a reader that sees any new field also sees it
+    std::atomic_thread_fence(std::memory_order_release);
+    auto& event = ring->events[idx % TraceRingSize];
+    event.name.store(name_, std::memory_order_relaxed);
+    event.start_ns.store(start_, std::memory_order_relaxed);
+    event.duration_ns.store(end - start_, std::memory_order_relaxed);
+    ring->write.store(idx + 1, std::memory_order_release);
+}
+
+EXPORT void mugfx_trace_dump(mugfx_trace_write write, void* ctx)
+{
+    TraceWriter writer(write, ctx);
+    writer.append("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+    auto& registry = get_trace_registry();
+    std::lock_guard lock(registry.mutex);
+    bool first = true;
+    for (size_t r = 0; r < registry.num_rings; ++r) {
+        auto& ring = *registry.rings[r];
+        const auto write_idx = ring.write.load(std::memory_order_acquire);
+        const auto oldest = write_idx > TraceRingSize ? write_idx - TraceRingSize : 0;
+        const auto begin = std::max(ring.read, oldest);
+        for (auto i = begin; i < write_idx; ++i) {
+            const auto& event = ring.events[i % TraceRingSize];
+            const auto name = event.name.load(std::memory_order_relaxed);
+            const auto start = event.start_ns.load(std::memory_order_relaxed);
+            const auto duration = event.duration_ns.load(std::memory_order_relaxed);
+            // Skip the event if the thread wrapped around and started overwriting it (with event
+            // i + TraceRingSize) before we finished reading it
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (ring.claimed.load(std::memory_order_relaxed) - i > TraceRingSize) {
+                continue;
+            }
+
+            std::array<char, 256> buf;
+            const auto len = std::snprintf(buf.data(), buf.size(),
+                "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%llu.%03llu,"
+                "\"dur\":%llu.%03llu}",
+                first ? "" : ",", name, ring.thread_id,
+                static_cast<unsigned long long>(start / 1000),
+                static_cast<unsigned long long>(start % 1000),
+                static_cast<unsigned long long>(duration / 1000),
+                static_cast<unsigned long long>(duration % 1000));
+            writer.append(buf.data(), std::min(static_cast<size_t>(len), buf.size() - 1));
+            first = false;
+        }
+        ring.read = write_idx;
+    }
+
+    writer.append("]}");
+}
+#else
+EXPORT void mugfx_trace_dump(mugfx_trace_write write, void* ctx)
+{
+    TraceWriter writer(write, ctx);
+    writer.append("{\"traceEvents\":[]}");
+}
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+
+// CPU tracing is compiled in with MUGFX_ENABLE_TRACING. Every scope is recorded as a single event
+// in a ring buffer of the calling thread, so tracing never takes a lock.
+
+#ifdef MUGFX_TRACING
+class TraceScope {
+public:
+    // `name` is not copied
+    TraceScope(const char* name);
+    ~TraceScope();
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name_;
+    uint64_t start_;
+};
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#endif
+
+#define TRACE_FUNCTION() TRACE_SCOPE(__func__)